@@ -0,0 +1,130 @@
+#include "background.h"
+
+#include "level.h"
+#include "tilesheet.h"
+#include "texture.h"
+
+#include <glm/gtc/packing.hpp>
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+static constexpr const auto TileScale = 2.0f; // same as sprites
+static constexpr const auto ChunkRows = 8;
+
+// non-negative, for chunks and rows below the start, which a layer scrolling the other way gets to
+static int wrap(int index, int count)
+{
+    const auto result = index % count;
+    return result < 0 ? result + count : result;
+}
+
+Background::Background(const Level *level, int viewport_height)
+    : viewport_height_(viewport_height)
+{
+    for (const auto &map : level->background)
+    {
+        auto layer = std::make_unique<Layer>();
+        layer->map = &map;
+
+        layer->tiles.reserve(map.tiles.size());
+        for (const auto &name : map.tiles)
+        {
+            const auto *tile = get_tile(name);
+            assert(tile);
+            assert(layer->tiles.empty() || tile->texture == layer->tiles.front()->texture);
+            assert(layer->tiles.empty() || tile->size == layer->tiles.front()->size);
+            layer->tiles.push_back(tile);
+        }
+        assert(!layer->tiles.empty());
+        layer->tile_size = TileScale * glm::vec2(layer->tiles.front()->size);
+
+        // enough for the chunks that can be partially visible at once
+        const auto chunk_height = ChunkRows * layer->tile_size.y;
+        const auto chunk_count = static_cast<int>(std::ceil(viewport_height_ / chunk_height)) + 1;
+        for (int i = 0; i < chunk_count; ++i)
+            layer->chunks.push_back(std::make_unique<Chunk>());
+
+        layers_.push_back(std::move(layer));
+    }
+
+    program_.add_shader(GL_VERTEX_SHADER, "resources/shaders/background.vert");
+    program_.add_shader(GL_FRAGMENT_SHADER, "resources/shaders/background.frag");
+    program_.link();
+
+    mvp_location_ = program_.uniform_location("mvp");
+    offset_location_ = program_.uniform_location("offset");
+}
+
+void Background::render(const glm::mat4 &mvp, float tic)
+{
+    if (layers_.empty())
+        return;
+
+    program_.bind();
+    program_.set_uniform(mvp_location_, mvp);
+
+    for (const auto &layer : layers_)
+    {
+        // rows of the repeated map are numbered upwards from the bottom of the viewport at tic 0
+        const auto scroll = std::max(tic, 0.0f) * layer->map->speed;
+        const auto chunk_height = ChunkRows * layer->tile_size.y;
+        const auto first_chunk = static_cast<int>(std::floor(scroll / chunk_height));
+        const auto last_chunk = static_cast<int>(std::floor((scroll + viewport_height_) / chunk_height));
+        assert(last_chunk - first_chunk < layer->chunks.size());
+
+        layer->tiles.front()->texture->bind();
+
+        for (int index = first_chunk; index <= last_chunk; ++index)
+        {
+            auto &chunk = *layer->chunks[wrap(index, layer->chunks.size())];
+            if (chunk.index != index)
+                update_chunk(*layer, chunk, index);
+
+            // chunk vertices are relative to the bottom left of the chunk
+            const auto bottom = viewport_height_ + scroll - index * chunk_height;
+            program_.set_uniform(offset_location_, glm::vec2(0.0f, bottom));
+            chunk.geometry.render(GL_TRIANGLES);
+        }
+    }
+}
+
+void Background::update_chunk(const Layer &layer, Chunk &chunk, int index)
+{
+    const auto *map = layer.map;
+
+    std::vector<Vertex> verts;
+    verts.reserve(ChunkRows * map->width * 6);
+
+    for (int i = 0; i < ChunkRows; ++i)
+    {
+        const auto map_row = map->height - 1 - wrap(index * ChunkRows + i, map->height);
+        for (int j = 0; j < map->width; ++j)
+        {
+            const auto cell = map->cells[map_row * map->width + j];
+            if (cell < 0)
+                continue;
+
+            const auto *tile = layer.tiles[cell];
+
+            const auto x0 = j * layer.tile_size.x;
+            const auto x1 = x0 + layer.tile_size.x;
+            const auto y1 = -i * layer.tile_size.y;
+            const auto y0 = y1 - layer.tile_size.y;
+
+            const auto &tex_coords = tile->tex_coords;
+            const auto uv = [&tex_coords](int corner) { return glm::packUnorm<glm::uint16>(tex_coords[corner]); };
+            const GLuint texture_layer = tile->layer;
+
+            const Vertex v0{{x0, y0}, uv(0), texture_layer};
+            const Vertex v1{{x0, y1}, uv(1), texture_layer};
+            const Vertex v2{{x1, y1}, uv(2), texture_layer};
+            const Vertex v3{{x1, y0}, uv(3), texture_layer};
+            verts.insert(verts.end(), {v0, v1, v2, v2, v3, v0});
+        }
+    }
+
+    chunk.geometry.set_data(verts);
+    chunk.index = index;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "geometry.h"
+#include "shaderprogram.h"
+
+#include <glm/mat4x4.hpp>
+
+#include <memory>
+#include <tuple>
+#include <vector>
+
+struct Level;
+struct BackgroundLayer;
+struct Tile;
+
+// Scrolling tile map layers of a level. Each layer is cut into chunks of rows with their own static VBO,
+// and only as many chunks as fit on screen are kept around; a chunk is rebuilt only when it scrolls into view.
+class Background
+{
+public:
+    Background(const Level *level, int viewport_height);
+
+    // fractional for interpolation; rebuilds the chunks that scrolled into view
+    void render(const glm::mat4 &mvp, float tic);
+
+private:
+    using Vertex = std::tuple<glm::vec2, glm::u16vec2, GLuint>;
+
+    struct Chunk
+    {
+        int index = -1; // chunk of the endlessly repeated map currently in the VBO
+        Geometry<Vertex> geometry;
+    };
+
+    struct Layer
+    {
+        const BackgroundLayer *map;
+        std::vector<const Tile *> tiles;
+        glm::vec2 tile_size;
+        std::vector<std::unique_ptr<Chunk>> chunks;
+    };
+
+    void update_chunk(const Layer &layer, Chunk &chunk, int index);
+
+    int viewport_height_;
+    std::vector<std::unique_ptr<Layer>> layers_;
+    ShaderProgram program_;
+    int mvp_location_;
+    int offset_location_;
+};
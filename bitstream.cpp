@@ -0,0 +1,165 @@
+#include "bitstream.h"
+
+#include <algorithm>
+#include <cassert>
+
+namespace
+{
+constexpr auto MaxUnary = 24; // that many ones means the value follows in full
+constexpr auto MaxK = 24;
+constexpr auto ContextWindow = 64; // values a context remembers, about, so it adapts when things change
+
+uint32_t zigzag(int32_t value)
+{
+    return (static_cast<uint32_t>(value) << 1) ^ static_cast<uint32_t>(value >> 31);
+}
+
+int32_t unzigzag(uint32_t value)
+{
+    return static_cast<int32_t>(value >> 1) ^ -static_cast<int32_t>(value & 1);
+}
+}
+
+int RiceContext::k() const
+{
+    int k = 0;
+    while (k < MaxK && (static_cast<uint64_t>(count_) << k) < sum_)
+        ++k;
+    return k;
+}
+
+void RiceContext::update(uint32_t value)
+{
+    sum_ += std::min<uint32_t>(value, 1u << MaxK);
+    if (++count_ == ContextWindow)
+    {
+        sum_ /= 2;
+        count_ /= 2;
+    }
+}
+
+void RiceContext::reset()
+{
+    sum_ = count_ = 0;
+}
+
+void BitWriter::put_bits(uint32_t value, int bits)
+{
+    assert(bits <= 32);
+    while (bits > 0)
+    {
+        if (used_bits_ == 8)
+        {
+            data_.push_back(0);
+            used_bits_ = 0;
+        }
+        const auto n = std::min(bits, 8 - used_bits_);
+        const auto chunk = (value >> (bits - n)) & ((1u << n) - 1);
+        data_.back() |= chunk << (8 - used_bits_ - n);
+        used_bits_ += n;
+        bits -= n;
+    }
+}
+
+void BitWriter::put_rice(uint32_t value, int k)
+{
+    const auto q = value >> k;
+    if (q >= MaxUnary)
+    {
+        put_bits((1u << MaxUnary) - 1, MaxUnary);
+        put_bits(value, 32);
+        return;
+    }
+    put_bits(((1u << q) - 1) << 1, q + 1); // q ones and a zero
+    if (k > 0)
+        put_bits(value & ((1u << k) - 1), k);
+}
+
+void BitWriter::put_rice(uint32_t value, RiceContext &context)
+{
+    put_rice(value, context.k());
+    context.update(value);
+}
+
+void BitWriter::put_signed_rice(int32_t value, RiceContext &context)
+{
+    put_rice(zigzag(value), context);
+}
+
+void BitWriter::clear()
+{
+    data_.clear();
+    used_bits_ = 8;
+}
+
+BitReader::BitReader(const uint8_t *data, std::size_t size)
+    : data_(data)
+    , size_(size)
+{
+}
+
+bool BitReader::get_bits(uint32_t &value, int bits)
+{
+    assert(bits <= 32);
+    if (bit_ + bits > 8 * size_)
+        return false;
+
+    value = 0;
+    while (bits > 0)
+    {
+        const auto used_bits = static_cast<int>(bit_ % 8);
+        const auto n = std::min(bits, 8 - used_bits);
+        const auto chunk = (data_[bit_ / 8] >> (8 - used_bits - n)) & ((1u << n) - 1);
+        value = (static_cast<uint64_t>(value) << n) | chunk;
+        bit_ += n;
+        bits -= n;
+    }
+    return true;
+}
+
+bool BitReader::get_bit(bool &value)
+{
+    uint32_t bit;
+    if (!get_bits(bit, 1))
+        return false;
+    value = bit;
+    return true;
+}
+
+bool BitReader::get_rice(uint32_t &value, int k)
+{
+    uint32_t q = 0;
+    bool bit;
+    while (true)
+    {
+        if (!get_bit(bit))
+            return false;
+        if (!bit)
+            break;
+        if (++q == MaxUnary)
+            return get_bits(value, 32);
+    }
+
+    uint32_t low = 0;
+    if (k > 0 && !get_bits(low, k))
+        return false;
+    value = (q << k) | low;
+    return true;
+}
+
+bool BitReader::get_rice(uint32_t &value, RiceContext &context)
+{
+    if (!get_rice(value, context.k()))
+        return false;
+    context.update(value);
+    return true;
+}
+
+bool BitReader::get_signed_rice(int32_t &value, RiceContext &context)
+{
+    uint32_t zigzagged;
+    if (!get_rice(zigzagged, context))
+        return false;
+    value = unzigzag(zigzagged);
+    return true;
+}
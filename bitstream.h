@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Bit level (de)serialization, most significant bit first, with Golomb-Rice codes for values that are
+// usually small. RiceContext picks the parameter from what the values so far looked like, so both ends
+// have to code the same values through the same contexts in the same order.
+
+class RiceContext
+{
+public:
+    // the parameter k for the next value: about log2 of the running mean
+    int k() const;
+
+    void update(uint32_t value);
+    void reset();
+
+private:
+    uint32_t sum_ = 0;
+    uint32_t count_ = 0;
+};
+
+class BitWriter
+{
+public:
+    void put_bits(uint32_t value, int bits); // bits <= 32
+    void put_bit(bool value) { put_bits(value, 1); }
+
+    // value >> k in unary, then the low k bits; values with too long a unary part are escaped and written in
+    // full instead, so a bad guess at k never costs more than a few bytes
+    void put_rice(uint32_t value, int k);
+    void put_rice(uint32_t value, RiceContext &context);
+
+    // zigzag mapped, so small negative values are cheap too
+    void put_signed_rice(int32_t value, RiceContext &context);
+
+    // padded with zeros to the next byte
+    const std::vector<uint8_t> &data() const { return data_; }
+    std::size_t bit_count() const { return data_.size() * 8 - (8 - used_bits_) % 8; }
+    void clear();
+
+private:
+    std::vector<uint8_t> data_;
+    int used_bits_ = 8; // in data_.back()
+};
+
+class BitReader
+{
+public:
+    BitReader(const uint8_t *data, std::size_t size);
+
+    // all of these return false past the end, which then counts as malformed
+    bool get_bits(uint32_t &value, int bits);
+    bool get_bit(bool &value);
+    bool get_rice(uint32_t &value, int k);
+    bool get_rice(uint32_t &value, RiceContext &context);
+    bool get_signed_rice(int32_t &value, RiceContext &context);
+
+private:
+    const uint8_t *data_;
+    std::size_t size_;
+    std::size_t bit_ = 0;
+};
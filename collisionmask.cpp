@@ -1,7 +1,6 @@
 #include "collisionmask.h"
 
 #include "tilesheet.h"
-#include "texture.h"
 #include "pixmap.h"
 
 CollisionMask::CollisionMask(const Tile *tile)
@@ -77,7 +76,7 @@ bool CollisionMask::test_bitmasks(const Bitmask &mask0, const Bitmask &mask1, in
 
 void CollisionMask::initialize_mask()
 {
-    const auto *pm = tile->texture->pixmap();
+    const auto *pm = tile->pixmap;
     assert(pm->type == Pixmap::PixelType::RGBAlpha); // XXX for now
 
     const auto *pixels = reinterpret_cast<const uint32_t *>(pm->pixels.data());
@@ -1 +1,37 @@
 #include "foeclass.h"
+
+#include "tilesheet.h"
+
+#include <cassert>
+#include <string>
+
+std::vector<FoeClass> g_foe_classes;
+
+void initialize_foe_classes()
+{
+    struct FoeInfo
+    {
+        std::vector<std::string> frames;
+        int tics_per_frame;
+        int shields;
+    };
+    static const std::vector<FoeInfo> foes = {
+        {{ "small-foe-0.png", "small-foe-1.png", "small-foe-2.png", "small-foe-3.png" }, 4, 2},
+        {{ "cube-foe-0.png", "cube-foe-1.png", "cube-foe-2.png", "cube-foe-3.png" }, 6, 5},
+    };
+
+    g_foe_classes.reserve(foes.size());
+    for (const auto &foe : foes)
+    {
+        FoeClass foe_class;
+        for (const auto &tile_name : foe.frames)
+        {
+            const auto *tile = get_tile(tile_name);
+            assert(tile);
+            foe_class.frames.push_back({tile, CollisionMask(tile)});
+        }
+        foe_class.tics_per_frame = foe.tics_per_frame;
+        foe_class.shields = foe.shields;
+        g_foe_classes.push_back(foe_class);
+    }
+}
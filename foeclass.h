@@ -17,3 +17,8 @@ struct FoeClass
     int tics_per_frame;
     int shields;
 };
+
+extern std::vector<FoeClass> g_foe_classes;
+
+// needs the tilesheets cached
+void initialize_foe_classes();
@@ -1,86 +1,69 @@
 #include "font.h"
 
-#include "texture.h"
-#include "shaderprogram.h"
-#include "geometry.h"
+#include "tilesheet.h"
+#include "spritebatcher.h"
+
+#include <array>
+#include <cassert>
 
 namespace
 {
-class FontRenderer
-{
-public:
-    FontRenderer();
-
-    void render_text(const glm::mat4 &mvp, float x, float y, const std::string_view text);
-
-private:
-    void initialize_gl_resources();
-
-    static constexpr const int MaxVerts = 1024;
+constexpr const auto FirstChar = ' ';
+constexpr const auto LastChar = '~';
+constexpr const auto CharSize = 16;
+constexpr const auto GlyphScale = 2.0f;
 
-    Texture texture_;
-    ShaderProgram program_;
-    using Vertex = std::tuple<glm::vec2, glm::vec2>;
-    Geometry<Vertex> geometry_;
-};
-
-FontRenderer::FontRenderer()
-    : texture_("resources/images/font.png")
+const Tile *glyph_tile(char ch)
 {
-    initialize_gl_resources();
+    static const auto tiles = [] {
+        std::array<const Tile *, LastChar - FirstChar + 1> tiles;
+        for (int i = 0; i < tiles.size(); ++i)
+        {
+            tiles[i] = get_tile("font-" + std::to_string(FirstChar + i) + ".png");
+            assert(tiles[i]);
+        }
+        return tiles;
+    }();
+    if (ch < FirstChar || ch > LastChar)
+        ch = '?';
+    return tiles[ch - FirstChar];
+}
 }
 
-void FontRenderer::initialize_gl_resources()
+Text::Text(std::string_view text)
 {
-    program_.add_shader(GL_VERTEX_SHADER, "resources/shaders/font.vert");
-    program_.add_shader(GL_FRAGMENT_SHADER, "resources/shaders/font.frag");
-    program_.link();
-
-    geometry_.set_data(nullptr, MaxVerts);
+    set_text(text);
 }
 
-void FontRenderer::render_text(const glm::mat4 &mvp, float x, float y, const std::string_view text)
+void Text::set_text(std::string_view text)
 {
-    constexpr const auto CharSize = 16;
-
-    constexpr const auto CharCols = 95;
-    constexpr const auto CharRows = 8;
-
-    constexpr const auto du = 1.f / CharCols;
-    constexpr const auto dv = 1.f / CharRows;
-
-    x -= 0.5f * CharSize * text.size();
-    y -= 0.5f * CharSize;
-
-    auto *vertex = geometry_.map_vertex_data();
-    for (char ch : text)
+    const auto length = text.size();
+    if (length != text_.size())
     {
-        const float u = (ch - ' ') * du;
-        const float v = 0.0f;
-
-        *vertex++ = {glm::vec2(x, y), glm::vec2(u, v)};
-        *vertex++ = {glm::vec2(x + CharSize, y), glm::vec2(u + du, v)};
-        *vertex++ = {glm::vec2(x + CharSize, y + CharSize), glm::vec2(u + du, v + dv)};
-
-        *vertex++ = {glm::vec2(x + CharSize, y + CharSize), glm::vec2(u + du, v + dv)};
-        *vertex++ = {glm::vec2(x, y + CharSize), glm::vec2(u, v + dv)};
-        *vertex++ = {glm::vec2(x, y), glm::vec2(u, v)};
-
-        x += CharSize;
+        // glyph positions are relative to the center, so they all move when the length changes
+        glyphs_.resize(length, {nullptr, {}});
+        for (std::size_t i = 0; i < length; ++i)
+            glyphs_[i].offset = glm::vec2((i - 0.5f * (length - 1)) * CharSize, 0.0f);
+        text_.resize(length, '\0');
     }
-    geometry_.unmap_vertex_data();
 
-    program_.bind();
-    program_.set_uniform(program_.uniform_location("mvp"), mvp);
-    program_.set_uniform(program_.uniform_location("sprite_texture"), 0);
-
-    texture_.bind();
-    geometry_.render(GL_TRIANGLES, text.size() * 6);
+    for (std::size_t i = 0; i < length; ++i)
+    {
+        if (text[i] != text_[i] || !glyphs_[i].tile)
+        {
+            glyphs_[i].tile = glyph_tile(text[i]);
+            text_[i] = text[i];
+        }
+    }
 }
+
+void Text::draw(SpriteBatcher &batcher, const glm::vec2 &center, const glm::vec4 &color, int depth) const
+{
+    for (const auto &glyph : glyphs_)
+        batcher.add_sprite(glyph.tile, center + glyph.offset, glm::vec2(GlyphScale), 0.0f, color, depth);
 }
 
-void render_text(const glm::mat4 &mvp, float x, float y, const std::string_view text)
+void Text::draw(SpriteBatcher &batcher, const glm::vec2 &center, int depth) const
 {
-    static FontRenderer renderer;
-    renderer.render_text(mvp, x, y, text);
+    draw(batcher, center, glm::vec4(0.0f), depth);
 }
@@ -1,6 +1,36 @@
 #pragma once
 
-#include <glm/mat4x4.hpp>
+#include <glm/vec2.hpp>
+#include <glm/vec4.hpp>
+
+#include <string>
 #include <string_view>
+#include <vector>
+
+struct Tile;
+class SpriteBatcher;
+
+// A line of text laid out as glyph sprites from the font tilesheet. Keep one around for text that is drawn
+// every frame: set_text() only looks up glyphs for the characters that changed.
+class Text
+{
+public:
+    explicit Text(std::string_view text = {});
+
+    void set_text(std::string_view text);
+    const std::string &text() const { return text_; }
+
+    // centered on center; with a non-zero color.a the glyphs are tinted
+    void draw(SpriteBatcher &batcher, const glm::vec2 &center, const glm::vec4 &color, int depth) const;
+    void draw(SpriteBatcher &batcher, const glm::vec2 &center, int depth) const;
+
+private:
+    struct Glyph
+    {
+        const Tile *tile;
+        glm::vec2 offset; // from the center of the text
+    };
 
-void render_text(const glm::mat4 &mvp, float x, float y, const std::string_view text);
+    std::string text_;
+    std::vector<Glyph> glyphs_;
+};
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <chrono>
+
+// What the game, the match server and the tools have to agree on for their simulations and checksums to
+// match.
+
+constexpr auto ViewportWidth = 400;
+constexpr auto ViewportHeight = 600;
+
+constexpr auto TicsPerSecond = 60;
+constexpr auto TicDuration = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+    std::chrono::duration<float, std::milli>(1000.0f / TicsPerSecond));
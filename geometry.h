@@ -2,13 +2,28 @@
 
 #include <boost/noncopyable.hpp>
 
+#include "renderstate.h"
+
 #include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
+#include <glm/gtc/type_precision.hpp>
 #include <GL/glew.h>
 
 #include <tuple>
 #include <vector>
 #include <iostream>
 
+// two half-precision floats
+struct hvec2
+{
+    hvec2() = default;
+    hvec2(const glm::vec2 &v)
+        : bits(glm::packHalf(v))
+    { }
+
+    glm::u16vec2 bits;
+};
+
 namespace detail
 {
 template<typename T>
@@ -19,6 +34,8 @@ struct vertex_component_traits<float>
 {
     static constexpr GLint size = 1;
     static constexpr GLenum type = GL_FLOAT;
+    static constexpr GLboolean normalized = GL_FALSE;
+    static constexpr bool integer = false;
 };
 
 template<>
@@ -26,6 +43,8 @@ struct vertex_component_traits<glm::vec2>
 {
     static constexpr GLint size = 2;
     static constexpr GLenum type = GL_FLOAT;
+    static constexpr GLboolean normalized = GL_FALSE;
+    static constexpr bool integer = false;
 };
 
 template<>
@@ -33,6 +52,8 @@ struct vertex_component_traits<glm::vec3>
 {
     static constexpr GLint size = 3;
     static constexpr GLenum type = GL_FLOAT;
+    static constexpr GLboolean normalized = GL_FALSE;
+    static constexpr bool integer = false;
 };
 
 template<>
@@ -40,6 +61,47 @@ struct vertex_component_traits<glm::vec4>
 {
     static constexpr GLint size = 4;
     static constexpr GLenum type = GL_FLOAT;
+    static constexpr GLboolean normalized = GL_FALSE;
+    static constexpr bool integer = false;
+};
+
+template<>
+struct vertex_component_traits<hvec2>
+{
+    static constexpr GLint size = 2;
+    static constexpr GLenum type = GL_HALF_FLOAT;
+    static constexpr GLboolean normalized = GL_FALSE;
+    static constexpr bool integer = false;
+};
+
+// 0-65535 read as 0.0-1.0
+template<>
+struct vertex_component_traits<glm::u16vec2>
+{
+    static constexpr GLint size = 2;
+    static constexpr GLenum type = GL_UNSIGNED_SHORT;
+    static constexpr GLboolean normalized = GL_TRUE;
+    static constexpr bool integer = false;
+};
+
+// 0-255 read as 0.0-1.0
+template<>
+struct vertex_component_traits<glm::u8vec4>
+{
+    static constexpr GLint size = 4;
+    static constexpr GLenum type = GL_UNSIGNED_BYTE;
+    static constexpr GLboolean normalized = GL_TRUE;
+    static constexpr bool integer = false;
+};
+
+// read as uint in the shader
+template<>
+struct vertex_component_traits<GLuint>
+{
+    static constexpr GLint size = 1;
+    static constexpr GLenum type = GL_UNSIGNED_INT;
+    static constexpr GLboolean normalized = GL_FALSE;
+    static constexpr bool integer = true;
 };
 
 template<typename T>
@@ -72,18 +134,29 @@ struct tuple_element_offset<Index, std::tuple<Head, Ts...>>
     static constexpr std::size_t value = tuple_element_offset<Index - 1, std::tuple<Ts...>>::value;
 };
 
+template<typename T>
+void declare_vertex_attrib_pointer(GLuint index, GLsizei stride, std::size_t offset)
+{
+    using attrib_traits = vertex_component_traits<T>;
+
+    glEnableVertexAttribArray(index);
+    if constexpr (attrib_traits::integer)
+        glVertexAttribIPointer(index, attrib_traits::size, attrib_traits::type, stride,
+                               reinterpret_cast<GLvoid *>(offset));
+    else
+        glVertexAttribPointer(index, attrib_traits::size, attrib_traits::type, attrib_traits::normalized, stride,
+                              reinterpret_cast<GLvoid *>(offset));
+}
+
 template<typename VertexT, std::size_t Index>
 void declare_vertex_attrib_pointer_for()
 {
     using attrib_type = typename std::tuple_element<Index, VertexT>::type;
-    using attrib_traits = vertex_component_traits<attrib_type>;
 
     constexpr size_t stride = tuple_stride<VertexT>::value;
     constexpr size_t offset = tuple_element_offset<Index, VertexT>::value;
 
-    glEnableVertexAttribArray(Index);
-    glVertexAttribPointer(Index, attrib_traits::size, attrib_traits::type, GL_FALSE, stride,
-                          reinterpret_cast<GLvoid *>(offset));
+    declare_vertex_attrib_pointer<attrib_type>(Index, stride, offset);
 }
 
 template<typename VertexT, std::size_t... Indexes>
@@ -113,6 +186,8 @@ public:
 
     ~Geometry()
     {
+        buffer_deleted(vbo_);
+        vertex_array_deleted(vao_);
         glDeleteBuffers(1, &vbo_);
         glDeleteVertexArrays(1, &vao_);
     }
@@ -124,9 +199,9 @@ public:
 
     void set_data(const VertexT *vert_data, int vert_count)
     {
-        glBindVertexArray(vao_);
+        bind_vertex_array(vao_);
 
-        glBindBuffer(GL_ARRAY_BUFFER, vbo_);
+        bind_buffer(GL_ARRAY_BUFFER, vbo_);
         glBufferData(GL_ARRAY_BUFFER, sizeof(VertexT) * vert_count, vert_data, GL_STATIC_DRAW);
 
         detail::declare_vertex_attrib_pointers(VertexT{});
@@ -136,17 +211,16 @@ public:
 
     VertexT *map_vertex_data()
     {
-        glBindBuffer(GL_ARRAY_BUFFER, vbo_);
+        bind_buffer(GL_ARRAY_BUFFER, vbo_);
         return reinterpret_cast<VertexT *>(glMapBuffer(GL_ARRAY_BUFFER, GL_WRITE_ONLY));
     }
 
     static void unmap_vertex_data()
     {
         glUnmapBuffer(GL_ARRAY_BUFFER);
-        glBindBuffer(GL_ARRAY_BUFFER, 0);
     }
 
-    void bind() const { glBindVertexArray(vao_); }
+    void bind() const { bind_vertex_array(vao_); }
 
     void render(GLenum mode) const
     {
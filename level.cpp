@@ -37,6 +37,38 @@ static std::unique_ptr<Trajectory> parse_trajectory(const rapidjson::Value &valu
     return std::make_unique<Trajectory>(path);
 }
 
+static BackgroundLayer parse_background_layer(const rapidjson::Value &value)
+{
+    assert(value.IsObject());
+
+    BackgroundLayer layer;
+    layer.speed = value["speed"].GetDouble();
+
+    const auto tiles = value["tiles"].GetArray();
+    std::transform(tiles.begin(), tiles.end(), std::back_inserter(layer.tiles), [](const rapidjson::Value &value) {
+        return std::string(value.GetString());
+    });
+
+    // one string per row, a digit indexes tiles and anything else is empty
+    const auto rows = value["map"].GetArray();
+    assert(!rows.Empty());
+    layer.width = rows[0].GetStringLength();
+    layer.height = rows.Size();
+    layer.cells.reserve(layer.width * layer.height);
+    for (const auto &row : rows)
+    {
+        assert(row.GetStringLength() == layer.width);
+        const auto *cells = row.GetString();
+        std::transform(cells, cells + layer.width, std::back_inserter(layer.cells), [&layer](char ch) {
+            const int index = ch >= '0' && ch <= '9' ? ch - '0' : -1;
+            assert(index < static_cast<int>(layer.tiles.size()));
+            return index;
+        });
+    }
+
+    return layer;
+}
+
 std::unique_ptr<Level> load_level(const std::string &path)
 {
     const auto json = load_file(path);
@@ -47,6 +79,15 @@ std::unique_ptr<Level> load_level(const std::string &path)
 
     auto level = std::make_unique<Level>();
 
+    if (document.HasMember("background"))
+    {
+        const auto background = document["background"].GetArray();
+        for (const auto &value : background)
+        {
+            level->background.push_back(parse_background_layer(value));
+        }
+    }
+
     const auto trajectories = document["trajectories"].GetArray();
     for (const auto &value : trajectories)
     {
@@ -2,6 +2,7 @@
 
 #include <vector>
 #include <memory>
+#include <string>
 
 class Trajectory;
 
@@ -15,8 +16,19 @@ struct Wave
     const Trajectory *trajectory;
 };
 
+// tile map scrolled behind everything, repeating vertically
+struct BackgroundLayer
+{
+    float speed; // pixels per tic
+    std::vector<std::string> tiles; // all the same size
+    int width;
+    int height;
+    std::vector<int> cells; // row-major, top row first, index into tiles or -1 if empty
+};
+
 struct Level
 {
+    std::vector<BackgroundLayer> background; // back to front
     std::vector<std::unique_ptr<Trajectory>> trajectories;
     std::vector<std::unique_ptr<Wave>> waves;
 };
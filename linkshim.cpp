@@ -0,0 +1,123 @@
+#include "linkshim.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <memory>
+#include <string>
+
+namespace
+{
+template<typename Duration>
+Duration from_milliseconds(float ms)
+{
+    return std::chrono::duration_cast<Duration>(std::chrono::duration<float, std::milli>(ms));
+}
+}
+
+bool LinkConditions::parse(std::string_view spec)
+{
+    while (!spec.empty())
+    {
+        const auto end = std::min(spec.find(','), spec.size());
+        const auto item = spec.substr(0, end);
+        spec.remove_prefix(std::min(end + 1, spec.size()));
+
+        const auto eq = item.find('=');
+        if (eq == std::string_view::npos)
+            return false;
+
+        const auto key = item.substr(0, eq);
+        const std::string value_string(item.substr(eq + 1));
+        char *value_end;
+        const auto value = std::strtof(value_string.c_str(), &value_end);
+        if (value_string.empty() || *value_end != '\0' || value < 0)
+            return false;
+
+        if (key == "latency")
+            latency = value;
+        else if (key == "jitter")
+            jitter = value;
+        else if (key == "loss")
+            loss = value;
+        else if (key == "duplicate")
+            duplicate = value;
+        else if (key == "reorder")
+            reorder = value;
+        else
+            return false;
+    }
+
+    return loss <= 1 && duplicate <= 1 && reorder <= 1;
+}
+
+bool LinkConditions::is_perfect() const
+{
+    return latency == 0 && jitter == 0 && loss == 0 && duplicate == 0 && reorder == 0;
+}
+
+LinkShim::LinkShim(boost::asio::ip::udp::socket &socket, const LinkConditions &conditions, unsigned seed)
+    : socket_(socket)
+    , conditions_(conditions)
+    , rng_(seed)
+{
+}
+
+void LinkShim::send_to(const std::vector<uint8_t> &data, const boost::asio::ip::udp::endpoint &endpoint)
+{
+    std::uniform_real_distribution<float> uniform(0, 1);
+
+    ++stats_.sent;
+
+    if (uniform(rng_) < conditions_.loss)
+    {
+        ++stats_.dropped;
+        return;
+    }
+
+    const auto copies = uniform(rng_) < conditions_.duplicate ? 2 : 1;
+    if (copies > 1)
+        ++stats_.duplicated;
+
+    for (int i = 0; i < copies; ++i)
+    {
+        const auto delay = conditions_.latency + conditions_.jitter * uniform(rng_);
+        auto time = Clock::now() + from_milliseconds<Clock::duration>(delay);
+
+        if (uniform(rng_) < conditions_.reorder)
+        {
+            // held back long enough for the next few to overtake it
+            ++stats_.reordered;
+            time += from_milliseconds<Clock::duration>(20 + conditions_.jitter);
+        }
+        else
+        {
+            // jitter alone doesn't reorder, real links are mostly first in, first out
+            time = std::max(time, last_delivery_time_);
+            last_delivery_time_ = time;
+        }
+
+        send_after(time, data, endpoint);
+    }
+}
+
+void LinkShim::send_after(Clock::time_point time, const std::vector<uint8_t> &data,
+                          const boost::asio::ip::udp::endpoint &endpoint)
+{
+    if (time <= Clock::now())
+    {
+        boost::system::error_code ignored_error;
+        socket_.send_to(boost::asio::buffer(data), endpoint, 0, ignored_error);
+        return;
+    }
+
+    auto timer = std::make_shared<boost::asio::steady_timer>(socket_.get_executor(), time);
+    auto datagram = std::make_shared<std::vector<uint8_t>>(data);
+    timer->async_wait(
+        [this, timer, datagram, endpoint](boost::system::error_code ec)
+        {
+            if (ec)
+                return;
+            boost::system::error_code ignored_error;
+            socket_.send_to(boost::asio::buffer(*datagram), endpoint, 0, ignored_error);
+        });
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <boost/asio.hpp>
+#include <boost/noncopyable.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <random>
+#include <string_view>
+#include <vector>
+
+// How bad the link should look, one way.
+struct LinkConditions
+{
+    float latency = 0; // ms
+    float jitter = 0; // ms, added to the latency uniformly at random
+    float loss = 0; // probability
+    float duplicate = 0; // probability
+    float reorder = 0; // probability a datagram gets held back behind later ones
+
+    // "latency=50,jitter=10,loss=0.02,duplicate=0.01,reorder=0.01", anything left out is perfect
+    bool parse(std::string_view spec);
+
+    bool is_perfect() const;
+};
+
+// Sits between a UDP socket and the wire and makes the link worse, for testing. Runs on the socket's
+// io_context, delayed datagrams are sent from timers there.
+class LinkShim : private boost::noncopyable
+{
+public:
+    LinkShim(boost::asio::ip::udp::socket &socket, const LinkConditions &conditions, unsigned seed);
+
+    void send_to(const std::vector<uint8_t> &data, const boost::asio::ip::udp::endpoint &endpoint);
+
+    // updated on the network thread, can be read from anywhere
+    struct Stats
+    {
+        std::atomic<int> sent = 0;
+        std::atomic<int> dropped = 0;
+        std::atomic<int> duplicated = 0;
+        std::atomic<int> reordered = 0;
+    };
+    const Stats &stats() const { return stats_; }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    void send_after(Clock::time_point time, const std::vector<uint8_t> &data,
+                    const boost::asio::ip::udp::endpoint &endpoint);
+
+    boost::asio::ip::udp::socket &socket_;
+    LinkConditions conditions_;
+    std::mt19937 rng_;
+    Clock::time_point last_delivery_time_; // in order delivery, unless reordered on purpose
+    Stats stats_;
+};
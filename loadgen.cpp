@@ -0,0 +1,529 @@
+#include "panic.h"
+
+#include "udpchannel.h"
+#include "packet.h"
+#include "snapshot.h"
+#include "scriptedinput.h"
+#include "gameconstants.h"
+
+#include <boost/asio.hpp>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <sys/resource.h>
+#include <unistd.h>
+
+// Load for zapray_server: bots that connect like the game does, two per match, and send scripted input at
+// 60 Hz. Asks the server how busy its workers were over the run and reports how many matches a core can hold
+// at that rate: matches / sum of each worker's busy fraction. Anything past a few percent late tics means
+// the server is past that point and the number is optimistic.
+//
+// Optionally some spectators watch the last match, decoding the snapshots they get; reports what that costs
+// per spectator.
+
+namespace
+{
+using Clock = std::chrono::steady_clock;
+
+constexpr auto InputDelay = 2; // tics, like the game's default
+constexpr auto MaxRollback = 8; // same, only for pairing up with bots like this one
+constexpr auto HelloInterval = std::chrono::milliseconds(100);
+constexpr auto SpectateInterval = std::chrono::seconds(1); // keeping the stream coming
+constexpr auto ConnectTimeout = std::chrono::seconds(10);
+constexpr auto StatsTimeout = std::chrono::seconds(1);
+constexpr auto WarmUpTime = std::chrono::seconds(1); // before measuring, so every match is running
+
+struct WorkerStats
+{
+    uint32_t matches;
+    uint32_t tics;
+    uint32_t late_tics;
+    uint32_t busy_us;
+    uint32_t desyncs;
+};
+
+class Bot
+{
+public:
+    Bot(boost::asio::io_context &io_context, const boost::asio::ip::udp::endpoint &server_endpoint, unsigned seed,
+        bool spectator)
+        : socket_(io_context, boost::asio::ip::udp::endpoint(boost::asio::ip::udp::v4(), 0))
+        , peer_endpoint_(server_endpoint)
+        , spectator_(spectator)
+        , input_(seed)
+        , receive_buffer_(MaxPacketSize)
+    {
+        channel_.set_session_id(std::random_device()());
+    }
+
+    void start()
+    {
+        send_hello();
+        do_receive();
+    }
+
+    void tic(Clock::time_point now)
+    {
+        if (!connected_)
+        {
+            if (now - last_hello_time_ > HelloInterval)
+                send_hello();
+            return;
+        }
+
+        if (spectator_)
+        {
+            if (now - last_hello_time_ > SpectateInterval)
+                send_hello();
+            return;
+        }
+
+        ++tic_;
+        channel_.queue_message({Message::Type::Input, static_cast<uint32_t>(tic_ + InputDelay), input_.next()});
+        send_data();
+    }
+
+    bool connected() const { return connected_; }
+    int tics() const { return tic_; }
+    int remote_inputs() const { return remote_inputs_; }
+
+    struct SpectatorStats
+    {
+        long bytes = 0; // of datagrams
+        int datagrams = 0;
+        int lost = 0;
+        int snapshots = 0;
+        int undecodable = 0; // deltas after a lost datagram, until the next keyframe
+    };
+    const SpectatorStats &spectator_stats() const { return spectator_stats_; }
+
+private:
+    // a Spectate once connected is the keepalive
+    void send_hello()
+    {
+        PacketWriter writer;
+        writer.put_u8(static_cast<uint8_t>(spectator_ ? PacketType::Spectate : PacketType::Hello));
+        writer.put_u32(ProtocolMagic);
+        writer.put_u8(ProtocolVersion);
+        writer.put_u32(channel_.session_id());
+        if (spectator_)
+        {
+            writer.put_u32(0); // the latest match
+        }
+        else
+        {
+            writer.put_u16(InputDelay);
+            writer.put_u16(MaxRollback);
+        }
+        send_packet(writer.data());
+        last_hello_time_ = Clock::now();
+    }
+
+    void send_data()
+    {
+        PacketWriter writer;
+        channel_.write_data(writer);
+        send_packet(writer.data());
+    }
+
+    void send_packet(const std::vector<uint8_t> &data)
+    {
+        boost::system::error_code ignored_error;
+        socket_.send_to(boost::asio::buffer(data), peer_endpoint_, 0, ignored_error);
+    }
+
+    void do_receive()
+    {
+        socket_.async_receive_from(boost::asio::buffer(receive_buffer_), sender_endpoint_,
+            [this](boost::system::error_code ec, std::size_t bytes_transferred)
+            {
+                if (ec == boost::asio::error::operation_aborted)
+                    return;
+
+                if (!ec)
+                    handle_packet(bytes_transferred);
+
+                do_receive();
+            });
+    }
+
+    void handle_packet(std::size_t size)
+    {
+        PacketReader reader(receive_buffer_.data(), size);
+
+        uint8_t type;
+        if (!reader.get_u8(type))
+            return;
+
+        if (static_cast<PacketType>(type) == PacketType::Welcome)
+        {
+            uint32_t magic, session_id;
+            uint16_t port;
+            if (connected_ || !reader.get_u32(magic) || magic != ProtocolMagic || !reader.get_u32(session_id) ||
+                session_id != channel_.session_id() || !reader.get_u16(port))
+                return;
+            peer_endpoint_.port(port);
+            channel_.touch();
+            connected_ = true;
+        }
+        else if (static_cast<PacketType>(type) == PacketType::Data)
+        {
+            messages_.clear();
+            if (!channel_.read_data(reader, messages_))
+                return;
+            remote_inputs_ += std::count_if(messages_.begin(), messages_.end(),
+                                            [](const Message &message) { return message.type == Message::Type::Input; });
+        }
+        else if (static_cast<PacketType>(type) == PacketType::SpectatorData)
+        {
+            handle_spectator_data(reader, size);
+        }
+    }
+
+    void handle_spectator_data(PacketReader &reader, std::size_t size)
+    {
+        uint32_t session_id;
+        uint16_t seq;
+        if (!reader.get_u32(session_id) || session_id != channel_.session_id() || !reader.get_u16(seq))
+            return;
+
+        auto &stats = spectator_stats_;
+        stats.bytes += size;
+        ++stats.datagrams;
+
+        if (have_seq_ && seq != next_seq_)
+        {
+            ++stats.lost;
+            for (auto &codec : codecs_)
+                codec.reset();
+        }
+        next_seq_ = seq + 1;
+        have_seq_ = true;
+
+        for (auto &codec : codecs_)
+        {
+            uint16_t snapshot_size;
+            const uint8_t *data;
+            if (!reader.get_u16(snapshot_size) || !reader.get_bytes(snapshot_size, data))
+                return;
+            if (snapshot_size == 0)
+                continue;
+
+            BitReader bits(data, snapshot_size);
+            if (codec.decode(bits, snapshot_))
+                ++stats.snapshots;
+            else
+                ++stats.undecodable;
+        }
+    }
+
+    boost::asio::ip::udp::socket socket_;
+    boost::asio::ip::udp::endpoint peer_endpoint_;
+    boost::asio::ip::udp::endpoint sender_endpoint_;
+    UdpChannel channel_;
+    bool spectator_;
+    ScriptedInput input_;
+    std::vector<uint8_t> receive_buffer_;
+    std::vector<Message> messages_;
+    Clock::time_point last_hello_time_;
+    bool connected_ = false;
+    int tic_ = 0;
+    int remote_inputs_ = 0;
+
+    std::array<SnapshotCodec, 2> codecs_; // for the match's two worlds
+    Snapshot snapshot_;
+    bool have_seq_ = false;
+    uint16_t next_seq_ = 0;
+    SpectatorStats spectator_stats_;
+};
+
+// asks the lobby, blocking
+std::vector<WorkerStats> request_stats(const boost::asio::ip::udp::endpoint &server_endpoint)
+{
+    boost::asio::io_context io_context;
+    boost::asio::ip::udp::socket socket(io_context, boost::asio::ip::udp::endpoint(boost::asio::ip::udp::v4(), 0));
+
+    PacketWriter writer;
+    writer.put_u8(static_cast<uint8_t>(PacketType::StatsRequest));
+    writer.put_u32(ProtocolMagic);
+    socket.send_to(boost::asio::buffer(writer.data()), server_endpoint);
+
+    std::vector<uint8_t> buffer(MaxPacketSize);
+    std::size_t size = 0;
+    socket.async_receive(boost::asio::buffer(buffer),
+                         [&size](boost::system::error_code ec, std::size_t bytes_transferred) {
+                             if (!ec)
+                                 size = bytes_transferred;
+                         });
+    io_context.run_for(StatsTimeout);
+    if (size == 0)
+        panic("no stats from the server\n");
+
+    PacketReader reader(buffer.data(), size);
+    uint8_t type, worker_count;
+    uint32_t magic;
+    if (!reader.get_u8(type) || static_cast<PacketType>(type) != PacketType::StatsReply || !reader.get_u32(magic) ||
+        magic != ProtocolMagic || !reader.get_u8(worker_count))
+        panic("bad stats from the server\n");
+
+    std::vector<WorkerStats> stats(worker_count);
+    for (auto &worker : stats)
+    {
+        if (!reader.get_u32(worker.matches) || !reader.get_u32(worker.tics) || !reader.get_u32(worker.late_tics) ||
+            !reader.get_u32(worker.busy_us) || !reader.get_u32(worker.desyncs))
+            panic("bad stats from the server\n");
+    }
+    return stats;
+}
+
+void report(const std::vector<WorkerStats> &start, const std::vector<WorkerStats> &end, double elapsed)
+{
+    if (start.size() != end.size())
+        panic("server restarted?\n");
+
+    int matches = 0;
+    double busy = 0;
+    std::cout << std::fixed << std::setprecision(2);
+    for (std::size_t i = 0; i < end.size(); ++i)
+    {
+        // differences wrap around like the counters
+        const uint32_t tics = end[i].tics - start[i].tics;
+        const uint32_t late_tics = end[i].late_tics - start[i].late_tics;
+        const double worker_busy = (end[i].busy_us - start[i].busy_us) * 1e-6 / elapsed;
+        std::cout << "worker " << i << ": " << end[i].matches << " matches, " << 100 * worker_busy << "% busy, "
+                  << tics << " tics, " << (tics ? 100.0 * late_tics / tics : 0.0) << "% late, "
+                  << end[i].desyncs - start[i].desyncs << " desyncs\n";
+        matches += end[i].matches;
+        busy += worker_busy;
+    }
+
+    std::cout << matches << " matches on " << end.size() << " workers, " << busy << " cores busy";
+    if (busy > 0)
+        std::cout << ", " << matches / busy << " matches per core at 60 Hz";
+    std::cout << '\n';
+}
+
+void report_spectators(const std::vector<std::unique_ptr<Bot>> &spectators,
+                       const std::vector<Bot::SpectatorStats> &start, double elapsed)
+{
+    Bot::SpectatorStats total;
+    for (std::size_t i = 0; i < spectators.size(); ++i)
+    {
+        const auto &stats = spectators[i]->spectator_stats();
+        total.bytes += stats.bytes - start[i].bytes;
+        total.datagrams += stats.datagrams - start[i].datagrams;
+        total.lost += stats.lost - start[i].lost;
+        total.snapshots += stats.snapshots - start[i].snapshots;
+        total.undecodable += stats.undecodable - start[i].undecodable;
+    }
+
+    constexpr auto UdpIpHeaderSize = 8 + 20;
+    const auto bytes = total.bytes / elapsed / spectators.size();
+    const auto wire_bytes = (total.bytes + UdpIpHeaderSize * total.datagrams) / elapsed / spectators.size();
+    std::cout << spectators.size() << " spectators: " << bytes << " bytes/s each, " << wire_bytes
+              << " with UDP/IPv4 headers; " << total.snapshots << " snapshots decoded, " << total.lost
+              << " datagrams lost, " << total.undecodable << " snapshots waited out for a keyframe\n";
+}
+
+// every bot needs a socket
+void raise_file_limit(int files)
+{
+    rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < static_cast<rlim_t>(files))
+    {
+        limit.rlim_cur = std::min<rlim_t>(limit.rlim_max, files);
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+}
+}
+
+static void usage(const char *argv0)
+{
+    std::cerr << "usage: " << argv0 << " [-h host] [-p port] [-m matches] [-s spectators] [-t seconds]\n";
+    std::exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+    std::string host = "127.0.0.1";
+    std::string port = "4141";
+    int matches = 100;
+    int spectator_count = 0;
+    int seconds = 10;
+
+    int c;
+    while ((c = getopt(argc, argv, "h:p:m:s:t:")) != EOF)
+    {
+        switch (c)
+        {
+            case 'h':
+                host = optarg;
+                break;
+
+            case 'p':
+                port = optarg;
+                break;
+
+            case 'm':
+                matches = std::atoi(optarg);
+                break;
+
+            case 's':
+                spectator_count = std::atoi(optarg);
+                break;
+
+            case 't':
+                seconds = std::atoi(optarg);
+                break;
+
+            default:
+                usage(argv[0]);
+        }
+    }
+
+    if (matches <= 0 || spectator_count < 0 || seconds <= 0)
+        usage(argv[0]);
+
+    raise_file_limit(2 * matches + spectator_count + 64);
+
+    boost::asio::io_context io_context;
+    boost::asio::ip::udp::resolver resolver(io_context);
+    const boost::asio::ip::udp::endpoint server_endpoint = *resolver.resolve(boost::asio::ip::udp::v4(), host, port);
+
+    std::vector<std::unique_ptr<Bot>> bots;
+    for (int i = 0; i < 2 * matches; ++i)
+    {
+        bots.push_back(std::make_unique<Bot>(io_context, server_endpoint, i + 1, false));
+        bots.back()->start();
+    }
+
+    // once all matches are up
+    std::vector<std::unique_ptr<Bot>> spectators;
+    for (int i = 0; i < spectator_count; ++i)
+        spectators.push_back(std::make_unique<Bot>(io_context, server_endpoint, 0, true));
+
+    // everyone connects, then runs for a bit before and while the server gets measured
+    enum class Phase
+    {
+        Connecting,
+        ConnectingSpectators,
+        WarmingUp,
+        Measuring,
+    };
+    auto phase = Phase::Connecting;
+    std::vector<WorkerStats> start_stats;
+    std::vector<Bot::SpectatorStats> start_spectator_stats;
+    auto start_time = Clock::now();
+    auto phase_time = start_time;
+    int late_tics = 0;
+
+    boost::asio::steady_timer timer(io_context);
+    auto tic_time = Clock::now();
+    std::function<void()> schedule_tic;
+    schedule_tic = [&] {
+        timer.expires_at(tic_time);
+        timer.async_wait([&](boost::system::error_code ec) {
+            if (ec)
+                return;
+
+            const auto now = Clock::now();
+            if (now - tic_time > TicDuration)
+                ++late_tics;
+
+            for (auto &bot : bots)
+                bot->tic(now);
+            if (phase != Phase::Connecting)
+            {
+                for (auto &spectator : spectators)
+                    spectator->tic(now);
+            }
+
+            const auto all_connected = [](const std::vector<std::unique_ptr<Bot>> &bots) {
+                return std::all_of(bots.begin(), bots.end(), [](const auto &bot) { return bot->connected(); });
+            };
+
+            switch (phase)
+            {
+                case Phase::Connecting:
+                    if (all_connected(bots))
+                    {
+                        std::cout << "connected " << bots.size() << " bots in "
+                                  << std::chrono::duration<double>(now - phase_time).count() << " s\n";
+                        for (auto &spectator : spectators)
+                            spectator->start();
+                        phase = Phase::ConnectingSpectators;
+                        phase_time = now;
+                    }
+                    else if (now - phase_time > ConnectTimeout)
+                    {
+                        panic("bots failed to connect\n");
+                    }
+                    break;
+
+                case Phase::ConnectingSpectators:
+                    if (all_connected(spectators))
+                    {
+                        phase = Phase::WarmingUp;
+                        phase_time = now;
+                    }
+                    else if (now - phase_time > ConnectTimeout)
+                    {
+                        panic("spectators failed to connect\n");
+                    }
+                    break;
+
+                case Phase::WarmingUp:
+                    if (now - phase_time > WarmUpTime)
+                    {
+                        start_stats = request_stats(server_endpoint);
+                        for (const auto &spectator : spectators)
+                            start_spectator_stats.push_back(spectator->spectator_stats());
+                        start_time = Clock::now();
+                        phase = Phase::Measuring;
+                    }
+                    break;
+
+                case Phase::Measuring:
+                    if (now - start_time > std::chrono::seconds(seconds))
+                    {
+                        const auto end_stats = request_stats(server_endpoint);
+                        const auto elapsed = std::chrono::duration<double>(Clock::now() - start_time).count();
+                        report(start_stats, end_stats, elapsed);
+                        if (!spectators.empty())
+                            report_spectators(spectators, start_spectator_stats, elapsed);
+                        io_context.stop();
+                        return;
+                    }
+                    break;
+            }
+
+            tic_time += TicDuration;
+            if (Clock::now() - tic_time > TicDuration)
+                tic_time = Clock::now(); // don't try to make up for it
+            schedule_tic();
+        });
+    };
+    schedule_tic();
+
+    io_context.run();
+
+    // the bots see each other's input through the server, minus what's still in flight
+    long sent = 0, received = 0;
+    for (const auto &bot : bots)
+    {
+        sent += bot->tics();
+        received += bot->remote_inputs();
+    }
+    std::cout << "bots sent " << sent << " inputs, received " << received << " ("
+              << 100.0 * received / std::max(1l, sent) << "%), loadgen was late on " << late_tics << " tics\n";
+}
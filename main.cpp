@@ -9,8 +9,18 @@
 #include "tilesheet.h"
 #include "dpadstate.h"
 #include "world.h"
+#include "background.h"
 #include "font.h"
 #include "foeclass.h"
+#include "renderstate.h"
+#include "renderlist.h"
+#include "triplebuffer.h"
+#include "rendertarget.h"
+#include "network.h"
+#include "udpnetwork.h"
+#include "session.h"
+#include "timesync.h"
+#include "gameconstants.h"
 
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
@@ -20,9 +30,8 @@
 #define GLM_ENABLE_EXPERIMENTAL
 #include <glm/gtx/string_cast.hpp>
 
-#include <boost/asio.hpp>
-
 #include <cassert>
+#include <cstdlib>
 #include <array>
 #include <vector>
 #include <algorithm>
@@ -30,364 +39,576 @@
 #include <memory>
 #include <thread>
 #include <iostream>
-#include <mutex>
-#include <condition_variable>
-#include <queue>
+#include <fstream>
+#include <random>
+#include <atomic>
+#include <chrono>
+#include <sstream>
+#include <iomanip>
 
 #define DRAW_FRAMES
+// #define PRINT_RENDER_STATS
 
 SpriteBatcher *g_sprite_batcher;
-unsigned g_dpad_state = 0;
-std::vector<FoeClass> g_foe_classes;
+std::atomic<unsigned> g_dpad_state = 0;
+std::atomic<bool> g_show_net_stats = false; // toggled with tab
 
-static constexpr const auto ViewportWidth = 400;
-static constexpr const auto ViewportHeight = 600;
 static constexpr const auto ViewportMargin = 12;
 static constexpr const auto WindowWidth = 2 * ViewportWidth + 3 * ViewportMargin;
 static constexpr const auto WindowHeight = ViewportHeight + 2 * ViewportMargin;
 
-static constexpr const auto TicsPerSecond = 60;
-static constexpr const auto MillisecondsPerTic = 1000.0f / TicsPerSecond;
+// sprites are drawn at 2x, so the game is rendered at half the viewport size and upscaled to the window
+static constexpr const auto NativeScale = 2;
+static constexpr const auto NativeWidth = ViewportWidth / NativeScale;
+static constexpr const auto NativeHeight = ViewportHeight / NativeScale;
+
+static constexpr const auto MaxCatchUpTics = 5; // after a longer hitch the missed time is dropped
+
+using Clock = std::chrono::steady_clock;
+
+static constexpr auto TextDepth = 100;
+
+static constexpr auto NetStatsLines = 5;
+static constexpr auto NetStatsLineHeight = 20;
+static constexpr auto NetStatsOverlayInterval = std::chrono::milliseconds(500);
 
 static constexpr auto ServerPort = 4141;
 
-static void initialize_foe_classes()
+class Game
 {
-    struct FoeInfo
+public:
+    enum class NetworkMode
     {
-        std::vector<std::string> frames;
-        int tics_per_frame;
-        int shields;
-    };
-    static const std::vector<FoeInfo> foes = {
-        {{ "small-foe-0.png", "small-foe-1.png", "small-foe-2.png", "small-foe-3.png" }, 4, 2},
-        {{ "cube-foe-0.png", "cube-foe-1.png", "cube-foe-2.png", "cube-foe-3.png" }, 6, 5},
+        Client,
+        Server,
+        Single
     };
 
-    g_foe_classes.reserve(foes.size());
-    for (const auto &foe : foes)
+    enum class Transport
     {
-        FoeClass foe_class;
-        for (const auto &tile_name : foe.frames)
-        {
-            const auto *tile = get_tile(tile_name);
-            assert(tile);
-            foe_class.frames.push_back({tile, CollisionMask(tile)});
-        }
-        foe_class.tics_per_frame = foe.tics_per_frame;
-        foe_class.shields = foe.shields;
-        g_foe_classes.push_back(foe_class);
-    }
-}
+        Udp,
+        Tcp, // fallback for networks that drop UDP
+    };
 
-template <typename T>
-class Queue
-{
-public:
-    void push(const T &value)
+    struct NetworkOptions
     {
-        {
-            std::lock_guard<std::mutex> lock(mutex_);
-            data_.push(value);
-        }
-        not_empty_.notify_one();
-    }
+        NetworkMode mode = NetworkMode::Single;
+        std::string host; // to connect to as a client
+        Transport transport = Transport::Udp;
+        LinkConditions link_conditions; // simulated, UDP only
+        Session::Settings session;
+        TimeSync::Settings time_sync;
+        int net_log_interval = 10; // seconds between NetStats lines on stdout, 0 for none
+    };
 
-    T pop()
-    {
-        std::unique_lock<std::mutex> lock(mutex_);
-        not_empty_.wait(lock, [this]() {
-            return !data_.empty();
-        });
+    Game(const NetworkOptions &options, int msaa_samples);
+    ~Game();
 
-        assert(!data_.empty());
-        const auto result = data_.front();
-        data_.pop();
+    // writes the local dpad state of every tic, one byte each, for render_bench
+    void record_session(const char *path);
 
-        return result;
-    }
+    void start(); // starts the simulation thread
+    bool running() const { return running_; }
+
+    void render(); // draws the latest snapshot published by the simulation
 
 private:
-    std::mutex mutex_;
-    std::queue<T> data_;
-    std::condition_variable not_empty_;
-};
+    // what the simulation hands over to the render thread every tic
+    struct Snapshot
+    {
+        std::array<RenderList, 2> worlds;
+        bool waiting = true; // for the other player
+        Clock::time_point tic_time; // when the last tic was due
+    };
 
-using Message = unsigned;
+    void run_simulation();
+    bool advance();
+    void handle_message(const Message &message);
+    void report_desyncs();
+    void sync_time();
+    void log_net_stats();
+    void update_net_stats_text();
+    void dump_state(const World &world, int tic, const char *which) const;
+    void publish_snapshot(Clock::time_point tic_time);
+
+    // simulation thread
+    NetworkMode mode_;
+    std::unique_ptr<Level> level_;
+    Session session_;
+    TimeSync time_sync_;
+    std::unique_ptr<NetworkThread> network_thread_;
+    std::chrono::seconds net_log_interval_;
+    NetStats::Sample net_log_sample_; // as of the last line logged
+    std::ofstream session_file_;
+    std::thread simulation_thread_;
+    std::atomic<bool> quit_ = false;
+    std::atomic<bool> running_ = true;
+
+    TripleBuffer<Snapshot> snapshots_;
+
+    // render thread
+    Background local_background_;
+    Background remote_background_;
+    RenderTarget native_target_; // both viewports side by side
+    ShaderProgram upscale_program_;
+    Geometry<std::tuple<glm::vec2, glm::vec2>> upscale_quads_;
+#ifdef DRAW_FRAMES
+    ShaderProgram frame_program_;
+    Geometry<std::tuple<glm::vec2>> frame_;
+#endif
+#ifdef DRAW_ACTIVE_TRAJECTORIES
+    ShaderProgram trajectory_program_;
+    std::vector<std::unique_ptr<Geometry<std::tuple<glm::vec2>>>> trajectories_; // same order as in the level
+#endif
+    Text waiting_text_;
+    std::array<Text, NetStatsLines> net_stats_text_;
+    NetStats::Sample net_stats_sample_; // as of the last overlay update
+};
 
-class NetworkThread
+Game::Game(const NetworkOptions &options, int msaa_samples)
+    : mode_(options.mode)
+    , level_(load_level("resources/levels/level-0.json"))
+    , session_(level_.get(), ViewportWidth, ViewportHeight, options.session)
+    , time_sync_(options.time_sync)
+    , net_log_interval_(options.net_log_interval)
+    , local_background_(level_.get(), ViewportHeight)
+    , remote_background_(level_.get(), ViewportHeight)
+    , native_target_(2 * NativeWidth, NativeHeight, msaa_samples)
+    , waiting_text_("WAITING FOR PLAYER")
 {
-public:
-    NetworkThread()
-        : socket_(io_context_)
+    std::vector<std::tuple<glm::vec2, glm::vec2>> upscale_verts;
+    for (int i = 0; i < 2; ++i)
     {
+        const float x0 = ViewportMargin + i * (ViewportWidth + ViewportMargin);
+        const float x1 = x0 + ViewportWidth;
+        const float y0 = ViewportMargin;
+        const float y1 = y0 + ViewportHeight;
+
+        // the native target is bottom-up, window coordinates are top-down
+        const float u0 = 0.5f * i;
+        const float u1 = u0 + 0.5f;
+
+        upscale_verts.insert(upscale_verts.end(), {{{x0, y0}, {u0, 1}},
+                                                   {{x1, y0}, {u1, 1}},
+                                                   {{x1, y1}, {u1, 0}},
+                                                   {{x1, y1}, {u1, 0}},
+                                                   {{x0, y1}, {u0, 0}},
+                                                   {{x0, y0}, {u0, 1}}});
     }
+    upscale_quads_.set_data(upscale_verts);
 
-    ~NetworkThread()
-    {
-        io_context_.stop(); // XXX can we actually do this?
-        thread_.join();
-    }
+    upscale_program_.add_shader(GL_VERTEX_SHADER, "resources/shaders/upscale.vert");
+    upscale_program_.add_shader(GL_FRAGMENT_SHADER, "resources/shaders/upscale.frag");
+    upscale_program_.link();
 
-    void start()
-    {
-        do_connect(); // XXX probably should do this without inheritance
-        thread_ = std::thread([this] { io_context_.run(); });
-    }
+#ifdef DRAW_FRAMES
+    constexpr float x0 = 0;
+    constexpr float x1 = ViewportWidth;
+    constexpr float y0 = 0;
+    constexpr float y1 = ViewportHeight;
 
-    void write_message(const Message &message)
-    {
-        io_context_.post(
-            [this, message]
-            {
-                boost::system::error_code ignored_error;
-                boost::asio::write(socket_, boost::asio::buffer(&message, sizeof(message)), ignored_error);
-            });
-    }
+    static const std::vector<std::tuple<glm::vec2>> frame_verts =
+        {{{x0, y0}}, {{x1, y0}}, {{x1, y1}}, {{x0, y1}}};
+    frame_.set_data(frame_verts);
 
-    Message read_remote_message()
-    {
-        return read_queue_.pop();
-    }
+    frame_program_.add_shader(GL_VERTEX_SHADER, "resources/shaders/dummy.vert");
+    frame_program_.add_shader(GL_FRAGMENT_SHADER, "resources/shaders/dummy.frag");
+    frame_program_.link();
+#endif
 
-    enum class Status
+#ifdef DRAW_ACTIVE_TRAJECTORIES
+    for (const auto &trajectory : level_->trajectories)
     {
-        Connecting,
-        Connected,
-        Disconnected,
-    };
+        std::vector<std::tuple<glm::vec2>> verts;
+
+        constexpr const auto NumVerts = 100;
+        for (int i = 0; i < NumVerts; ++i)
+        {
+            const auto t = static_cast<float>(i) / (NumVerts - 1);
+            verts.emplace_back(trajectory->point_at(t * trajectory->length()));
+        }
 
-    Status status() const { return status_; }
+        trajectories_.push_back(std::make_unique<Geometry<std::tuple<glm::vec2>>>());
+        trajectories_.back()->set_data(verts);
+    }
 
-protected:
-    virtual void do_connect() = 0;
+    trajectory_program_.add_shader(GL_VERTEX_SHADER, "resources/shaders/dummy.vert");
+    trajectory_program_.add_shader(GL_FRAGMENT_SHADER, "resources/shaders/dummy.frag");
+    trajectory_program_.link();
+#endif
 
-    void handle_connected(boost::system::error_code ec)
+    if (mode_ != NetworkMode::Single)
     {
-        if (!ec)
+        const auto port = std::to_string(ServerPort);
+        if (options.transport == Transport::Tcp)
         {
-            status_ = Status::Connected;
-
-            boost::asio::ip::tcp::no_delay option(true);
-            socket_.set_option(option);
-
-            do_read();
+            if (mode_ == NetworkMode::Server)
+                network_thread_.reset(new TcpServerNetworkThread(ServerPort));
+            else
+                network_thread_.reset(new TcpClientNetworkThread(options.host, port));
         }
         else
         {
-            status_ = Status::Disconnected;
+            std::unique_ptr<UdpNetworkThread> udp_thread;
+            if (mode_ == NetworkMode::Server)
+                udp_thread.reset(new UdpServerNetworkThread(ServerPort));
+            else
+                udp_thread.reset(new UdpClientNetworkThread(options.host, port));
+            if (!options.link_conditions.is_perfect())
+                udp_thread->set_link_conditions(options.link_conditions, std::random_device()());
+            network_thread_ = std::move(udp_thread);
         }
-    }
+        network_thread_->set_session_parameters({static_cast<uint16_t>(options.session.input_delay),
+                                                 static_cast<uint16_t>(options.session.max_rollback)});
+        network_thread_->start();
 
-    void do_read()
-    {
-        boost::asio::async_read(socket_,
-            boost::asio::buffer(&read_message_, sizeof(read_message_)),
-            [this](boost::system::error_code ec, std::size_t bytes_transferred)
-            {
-                if (!ec)
-                {
-                    read_queue_.push(read_message_);
-                    do_read();
-                }
-                else
-                {
-                    socket_.close();
-                    status_ = Status::Disconnected;
-                    read_queue_.push(0); // to unblock anyone reading the queue
-                }
-            });
+        net_log_sample_ = net_stats_sample_ = network_thread_->stats().sample();
     }
 
-    boost::asio::io_context io_context_;
-    boost::asio::ip::tcp::socket socket_;
-    std::thread thread_;
-    Message read_message_;
-    Queue<Message> read_queue_;
-    Status status_ = Status::Connecting;
-};
+    publish_snapshot(Clock::now());
+}
 
-class ServerNetworkThread : public NetworkThread
+Game::~Game()
 {
-public:
-    ServerNetworkThread(int port)
-        : acceptor_(io_context_, boost::asio::ip::tcp::endpoint(boost::asio::ip::tcp::v4(), port))
-    {
-    }
+    quit_ = true;
+    if (simulation_thread_.joinable())
+        simulation_thread_.join();
 
-private:
-    void do_connect() override
+    if (mode_ != NetworkMode::Single)
     {
-        acceptor_.async_accept(socket_,
-            [this](boost::system::error_code ec)
-            {
-                handle_connected(ec);
-            });
+        const auto &stats = session_.stats();
+        std::cout << "rollbacks: " << stats.rollbacks << ", resimulated tics: " << stats.resimulated_tics
+                  << ", stalled tics: " << stats.stalled_tics << ", checksums checked: " << stats.checksums_checked
+                  << ", desyncs: " << stats.desyncs << '\n';
+        std::cout << "rtt: " << network_thread_->rtt().count() / 1000.0f << " ms, advantage: " << time_sync_.advantage()
+                  << " tics\n";
     }
+}
 
-    boost::asio::ip::tcp::acceptor acceptor_;
-};
+void Game::record_session(const char *path)
+{
+    session_file_.open(path, std::ios::binary);
+    if (!session_file_)
+        panic("failed to open %s\n", path);
+}
 
-class ClientNetworkThread : public NetworkThread
+void Game::start()
 {
-public:
-    ClientNetworkThread(std::string_view host, std::string_view service)
-    {
-        boost::asio::ip::tcp::resolver resolver(io_context_);
-        endpoint_iterator_ = resolver.resolve(host, service);
-    }
+    simulation_thread_ = std::thread([this] { run_simulation(); });
+}
 
-private:
-    void do_connect() override
+void Game::run_simulation()
+{
+    auto tic_time = Clock::now();
+    auto last_tic_time = tic_time; // doesn't move while waiting for the other player
+    while (!quit_)
     {
-        boost::asio::async_connect(socket_, endpoint_iterator_,
-            [this](boost::system::error_code ec, boost::asio::ip::tcp::resolver::iterator)
-            {
-                handle_connected(ec);
-            });
+        const auto tic = session_.tic();
+        if (!advance())
+            break;
+        if (mode_ != NetworkMode::Single)
+            network_thread_->flush(); // everything the tic wrote, together
+        if (session_.tic() != tic)
+            last_tic_time = tic_time;
+        publish_snapshot(last_tic_time);
+
+        // catch up on late tics without sleeping, but only up to a point; stretched while ahead of the other side
+        tic_time += std::chrono::duration_cast<Clock::duration>(TicDuration * (1 + time_sync_.stretch()));
+        const auto now = Clock::now();
+        if (now - tic_time > MaxCatchUpTics * TicDuration)
+            tic_time = now;
+        std::this_thread::sleep_until(tic_time);
     }
+    running_ = false;
+}
 
-    boost::asio::ip::tcp::resolver::iterator endpoint_iterator_;
-};
-
-class Game
+bool Game::advance()
 {
-public:
-    enum class NetworkMode
+    if (mode_ != NetworkMode::Single)
     {
-        Client,
-        Server,
-        Single
-    };
+        const auto status = network_thread_->status();
+        if (status == NetworkThread::Status::Disconnected)
+            return false;
 
-    Game(NetworkMode mode, const std::string &host);
+        if (status == NetworkThread::Status::Connecting)
+            return true;
 
-    bool advance(float dt);
-    void render() const;
+        network_thread_->read_messages([this](const Message &message) { handle_message(message); });
+    }
 
-private:
-    void advance_one_tic();
+    const unsigned dpad_state = g_dpad_state;
 
-    NetworkMode mode_;
-    std::unique_ptr<Level> level_;
-    World local_;
-    World remote_;
-#ifdef DRAW_FRAMES
-    ShaderProgram frame_program_;
-    Geometry<std::tuple<glm::vec2>> frame_;
-#endif
-    float timestamp_ = 0.0f; // milliseconds
-    std::unique_ptr<NetworkThread> network_thread_;
-};
+    Session::Input input;
+    const auto advanced = session_.advance(dpad_state, input);
 
-Game::Game(NetworkMode mode, const std::string &host)
-    : mode_(mode)
-    , level_(load_level("resources/levels/level-0.json"))
-    , local_(ViewportWidth, ViewportHeight)
-    , remote_(ViewportWidth, ViewportHeight)
-{
-    local_.initialize_level(level_.get());
-    remote_.initialize_level(level_.get());
+    if (mode_ != NetworkMode::Single)
+    {
+        network_thread_->stats().add_tic(advanced);
+        report_desyncs();
+        sync_time();
+        log_net_stats();
+    }
 
-#ifdef DRAW_FRAMES
-    constexpr float x0 = 0;
-    constexpr float x1 = ViewportWidth;
-    constexpr float y0 = 0;
-    constexpr float y1 = ViewportHeight;
+    if (!advanced)
+        return true; // too far ahead of the other side, wait for its input
 
-    static const std::vector<std::tuple<glm::vec2>> frame_verts =
-        {{{x0, y0}}, {{x1, y0}}, {{x1, y1}}, {{x0, y1}}};
-    frame_.set_data(frame_verts);
-
-    frame_program_.add_shader(GL_VERTEX_SHADER, "resources/shaders/dummy.vert");
-    frame_program_.add_shader(GL_FRAGMENT_SHADER, "resources/shaders/dummy.frag");
-    frame_program_.link();
-#endif
+    if (session_file_.is_open())
+        session_file_.put(static_cast<char>(dpad_state));
 
     if (mode_ != NetworkMode::Single)
     {
-        if (mode == NetworkMode::Server)
-            network_thread_.reset(new ServerNetworkThread(ServerPort));
-        else
-            network_thread_.reset(new ClientNetworkThread(host, std::to_string(ServerPort)));
-        network_thread_->start();
+        network_thread_->write_message({Message::Type::Input, input.tic, input.dpad_state});
+
+        Session::Checksum checksum;
+        if (session_.local_checksum(checksum))
+            network_thread_->write_message({Message::Type::Checksum, checksum.tic, checksum.value});
+    }
+    else
+    {
+        session_.add_remote_input({input.tic, 0});
     }
+
+    return true;
 }
 
-bool Game::advance(float dt)
+void Game::handle_message(const Message &message)
 {
-    if (mode_ != NetworkMode::Single)
+    switch (message.type)
     {
-        const auto status = network_thread_->status();
-        if (status == NetworkThread::Status::Disconnected)
-            return false;
-
-        if (status == NetworkThread::Status::Connecting)
-            return true;
+        case Message::Type::Input:
+            session_.add_remote_input({message.tic, message.value});
+            break;
+
+        case Message::Type::Checksum:
+            session_.add_remote_checksum({message.tic, message.value});
+            break;
+
+        case Message::Type::TimeSync:
+            time_sync_.add_remote_report(session_.tic(), {message.tic, static_cast<int32_t>(message.value)});
+            break;
+
+        case Message::Type::Ping:
+        case Message::Type::Pong:
+            // the network thread's
+            break;
+
+        case Message::Type::Desync:
+            // our half of the diff, the other side dumped its view of our world
+            if (const auto *state = session_.checksummed_local_state(message.tic))
+                dump_state(*state, message.tic, "local");
+            else
+                std::cerr << "desync reported at tic " << message.tic << ", local state no longer around\n";
+            break;
     }
+}
 
-    timestamp_ += dt;
-    while (timestamp_ > MillisecondsPerTic)
+void Game::report_desyncs()
+{
+    for (const auto &desync : session_.take_desyncs())
     {
-        timestamp_ -= MillisecondsPerTic;
-        advance_one_tic();
+        std::cerr << "desync at tic " << desync.tic << '\n';
+        dump_state(desync.remote_state, desync.tic, "remote");
+        network_thread_->write_message({Message::Type::Desync, static_cast<uint32_t>(desync.tic), 0});
     }
+}
 
-    return true;
+void Game::sync_time()
+{
+    time_sync_.set_rtt(network_thread_->rtt());
+
+    TimeSync::Report report;
+    if (time_sync_.report(session_.tic(), report))
+        network_thread_->write_message(
+            {Message::Type::TimeSync, report.tic, static_cast<uint32_t>(report.advantage)});
 }
 
-void Game::advance_one_tic()
+static float milliseconds(std::chrono::microseconds duration)
 {
-    if (mode_ != NetworkMode::Single)
-        network_thread_->write_message(g_dpad_state);
-    local_.advance(g_dpad_state);
+    return std::chrono::duration<float, std::milli>(duration).count();
+}
 
-    const auto remote_dpad_state = mode_ != NetworkMode::Single ? network_thread_->read_remote_message() : 0;
-    remote_.advance(remote_dpad_state);
+void Game::log_net_stats()
+{
+    if (net_log_interval_.count() == 0 || Clock::now() - net_log_sample_.time < net_log_interval_)
+        return;
+
+    const auto sample = network_thread_->stats().sample();
+    const auto rates = NetStats::rates(net_log_sample_, sample);
+    std::cout << std::fixed << std::setprecision(1) << "net: rtt " << milliseconds(sample.rtt_p50) << '/'
+              << milliseconds(sample.rtt_p95) << '/' << milliseconds(sample.rtt_p99)
+              << " ms (p50/p95/p99), jitter " << milliseconds(sample.jitter) << " ms, sent "
+              << rates.bytes_sent_per_second << " B/s, received " << rates.bytes_received_per_second
+              << " B/s, receive queue " << sample.queue_depth << " (max " << sample.max_queue_depth << "), "
+              << sample.stalled_tics - net_log_sample_.stalled_tics << " tics stalled, " << std::setprecision(2)
+              << rates.stall_ms_per_tic << " ms/tic\n"
+              << std::defaultfloat;
+    net_log_sample_ = sample;
 }
 
-void Game::render() const
+void Game::dump_state(const World &world, int tic, const char *which) const
 {
-    const auto project =
-        glm::ortho(0.0f, static_cast<float>(WindowWidth), static_cast<float>(WindowHeight), 0.0f);
+    const auto path = "desync-" + std::to_string(tic) + "-" + (mode_ == NetworkMode::Server ? "server" : "client") +
+                      "-" + which + ".txt";
+    std::ofstream file(path);
+    world.dump(file);
+    std::cerr << "wrote " << path << '\n';
+}
+
+void Game::publish_snapshot(Clock::time_point tic_time)
+{
+    auto &snapshot = snapshots_.back();
+
+    const std::array<const World *, 2> worlds = {&session_.local(), &session_.remote()};
+    for (int i = 0; i < worlds.size(); ++i)
+    {
+        snapshot.worlds[i].clear();
+        worlds[i]->render(snapshot.worlds[i]);
+    }
 
+    snapshot.waiting = mode_ == NetworkMode::Single || network_thread_->status() == NetworkThread::Status::Connecting;
+    snapshot.tic_time = tic_time;
+
+    snapshots_.publish();
+}
+
+void Game::render()
+{
+    snapshots_.update();
+    const auto &snapshot = snapshots_.front();
+
+    // draw between the previous tic and the last one, by how far we are into the next
+    const auto alpha = std::clamp(std::chrono::duration<float>(Clock::now() - snapshot.tic_time) / TicDuration, 0.0f, 1.0f);
+
+    const std::array<Background *, 2> backgrounds = {&local_background_, &remote_background_};
+
+    // world coordinates stay in viewport units, the projection maps them to native pixels
+    const auto native_project = glm::ortho(0.0f, static_cast<float>(snapshot.worlds.size() * ViewportWidth),
+                                           static_cast<float>(ViewportHeight), 0.0f);
+
+    native_target_.bind();
+    glClearColor(0, 0, 0, 0);
+    glClear(GL_COLOR_BUFFER_BIT);
+
+    g_sprite_batcher->start_batch();
+
+    // sprites are clipped by the batcher, the scissor is only there for anything drawn directly
     glEnable(GL_SCISSOR_TEST);
 
-    const auto draw_viewport = [this, &project](const World &world, int x_offset) {
-        const auto translate
-            = glm::translate(glm::mat4(1.0f), glm::vec3(x_offset, ViewportMargin, 0.0f));
+    for (int i = 0; i < snapshot.worlds.size(); ++i)
+    {
+        const auto &list = snapshot.worlds[i];
 
-        glScissor(x_offset, ViewportMargin, ViewportWidth, ViewportHeight);
+        glScissor(i * NativeWidth, 0, NativeWidth, NativeHeight);
 
-        g_sprite_batcher->set_transform_matrix(project * translate);
-        g_sprite_batcher->start_batch();
-        world.render();
-        g_sprite_batcher->render_batch();
+        if (list.collision)
+        {
+            glClearColor(1, 0, 0, 1);
+            glClear(GL_COLOR_BUFFER_BIT);
+        }
 
-#ifdef DRAW_FRAMES
-        glDisable(GL_SCISSOR_TEST);
+        const auto transform =
+            native_project * glm::translate(glm::mat4(1.0f), glm::vec3(i * ViewportWidth, 0.0f, 0.0f));
+        g_sprite_batcher->set_viewport(i, transform, glm::vec4(0, 0, ViewportWidth, ViewportHeight));
+        g_sprite_batcher->set_current_viewport(i);
 
-        const auto mvp = frame_program_.uniform_location("mvp");
-        frame_program_.bind();
-        frame_program_.set_uniform(mvp, project * translate);
-        frame_.render(GL_LINE_LOOP);
+        // drawn right away, so it ends up under the sprites
+        backgrounds[i]->render(transform, list.tic - 1 + alpha);
 
-        glEnable(GL_SCISSOR_TEST);
+#ifdef DRAW_ACTIVE_TRAJECTORIES
+        trajectory_program_.bind();
+        trajectory_program_.set_uniform(trajectory_program_.uniform_location("mvp"), transform);
+        for (const auto *trajectory : list.trajectories)
+        {
+            const auto it = std::find_if(level_->trajectories.begin(), level_->trajectories.end(),
+                                         [trajectory](const auto &t) { return t.get() == trajectory; });
+            trajectories_[it - level_->trajectories.begin()]->render(GL_LINE_STRIP);
+        }
 #endif
-    };
 
-    draw_viewport(local_, ViewportMargin);
-    draw_viewport(remote_, 2 * ViewportMargin + ViewportWidth);
+        list.add_to_batch(*g_sprite_batcher, alpha);
+    }
 
-    if (mode_ == NetworkMode::Single || network_thread_->status() == NetworkThread::Status::Connecting)
+    if (snapshot.waiting)
     {
-        const auto translate
-            = glm::translate(glm::mat4(1.0f),
-                             glm::vec3(2 * ViewportMargin + ViewportWidth, ViewportMargin, 0.0f));
-        render_text(project * translate, 0.5f * ViewportWidth, 0.5f * ViewportHeight, "WAITING FOR PLAYER");
+        g_sprite_batcher->set_current_viewport(1);
+        waiting_text_.draw(*g_sprite_batcher, glm::vec2(0.5f * ViewportWidth, 0.5f * ViewportHeight), TextDepth);
+    }
+
+    if (g_show_net_stats && mode_ != NetworkMode::Single)
+    {
+        update_net_stats_text();
+        g_sprite_batcher->set_current_viewport(0);
+        for (int i = 0; i < NetStatsLines; ++i)
+        {
+            const auto center = glm::vec2(0.5f * ViewportWidth, (i + 1) * NetStatsLineHeight);
+            net_stats_text_[i].draw(*g_sprite_batcher, center, TextDepth);
+        }
     }
 
     glDisable(GL_SCISSOR_TEST);
+
+    g_sprite_batcher->render_batch();
+
+    native_target_.resolve();
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glViewport(0, 0, WindowWidth, WindowHeight);
+
+    const auto project =
+        glm::ortho(0.0f, static_cast<float>(WindowWidth), static_cast<float>(WindowHeight), 0.0f);
+
+    glDisable(GL_BLEND);
+    upscale_program_.bind();
+    upscale_program_.set_uniform(upscale_program_.uniform_location("mvp"), project);
+    bind_texture(GL_TEXTURE_2D, native_target_.texture());
+    upscale_quads_.render(GL_TRIANGLES);
+    glEnable(GL_BLEND);
+
+#ifdef DRAW_FRAMES
+    const auto mvp = frame_program_.uniform_location("mvp");
+    frame_program_.bind();
+    for (int i = 0; i < snapshot.worlds.size(); ++i)
+    {
+        const auto viewport_x = ViewportMargin + i * (ViewportWidth + ViewportMargin);
+        frame_program_.set_uniform(mvp,
+                                   project * glm::translate(glm::mat4(1.0f), glm::vec3(viewport_x, ViewportMargin, 0.0f)));
+        frame_.render(GL_LINE_LOOP);
+    }
+#endif
+
+#ifdef PRINT_RENDER_STATS
+    const auto &state_counters = render_state_counters();
+    const auto &stats = g_sprite_batcher->stats();
+    std::cout << "sprite draw calls: " << stats.draw_calls << ", quads: " << stats.quads
+              << ", texture switches: " << stats.texture_switches << ", uploaded: " << stats.bytes_uploaded
+              << " bytes, gpu: " << stats.gpu_milliseconds << " ms, binds issued: " << state_counters.issued
+              << ", binds skipped: " << state_counters.skipped << '\n';
+    reset_render_state_counters();
+#endif
+}
+
+void Game::update_net_stats_text()
+{
+    if (Clock::now() - net_stats_sample_.time < NetStatsOverlayInterval)
+        return;
+
+    const auto sample = network_thread_->stats().sample();
+    const auto rates = NetStats::rates(net_stats_sample_, sample);
+    net_stats_sample_ = sample;
+
+    std::array<std::ostringstream, NetStatsLines> lines;
+    for (auto &line : lines)
+        line << std::fixed << std::setprecision(1);
+    lines[0] << "RTT " << milliseconds(sample.rtt_p50) << '/' << milliseconds(sample.rtt_p95) << '/'
+             << milliseconds(sample.rtt_p99) << " MS";
+    lines[1] << "JITTER " << milliseconds(sample.jitter) << " MS";
+    lines[2] << std::setprecision(2) << "UP " << rates.bytes_sent_per_second / 1000 << " DOWN "
+             << rates.bytes_received_per_second / 1000 << " KB/S";
+    lines[3] << "QUEUE " << sample.queue_depth << " MAX " << sample.max_queue_depth;
+    lines[4] << std::setprecision(2) << "STALL " << rates.stall_ms_per_tic << " MS/TIC";
+
+    for (int i = 0; i < NetStatsLines; ++i)
+        net_stats_text_[i].set_text(lines[i].str());
 }
 
 static void update_dpad_state(GLFWwindow *window)
@@ -408,24 +629,67 @@ static void update_dpad_state(GLFWwindow *window)
 
 int main(int argc, char *argv[])
 {
-    std::string host;
-    Game::NetworkMode mode = Game::NetworkMode::Single;
+    Game::NetworkOptions network_options;
+    int msaa_samples = 0;
+    const char *session_path = nullptr;
+    const char *stats_path = nullptr;
 
     int c;
-    while ((c = getopt(argc, argv, "sc:")) != EOF)
+    while ((c = getopt(argc, argv, "sc:tl:m:r:S:d:w:n:")) != EOF)
     {
         switch (c)
         {
             case 's':
-                mode = Game::NetworkMode::Server;
+                network_options.mode = Game::NetworkMode::Server;
                 break;
 
             case 'c':
-                mode = Game::NetworkMode::Client;
-                host = optarg;
+                network_options.mode = Game::NetworkMode::Client;
+                network_options.host = optarg;
+                break;
+
+            case 't':
+                network_options.transport = Game::Transport::Tcp;
+                break;
+
+            case 'l':
+                if (!network_options.link_conditions.parse(optarg))
+                    panic("bad link conditions, expected latency=ms,jitter=ms,loss=p,duplicate=p,reorder=p\n");
+                break;
+
+            case 'm':
+                msaa_samples = std::atoi(optarg);
+                break;
+
+            case 'r':
+                session_path = optarg;
+                break;
+
+            case 'S':
+                stats_path = optarg;
+                break;
+
+            case 'd':
+                network_options.session.input_delay = std::max(0, std::atoi(optarg));
+                break;
+
+            case 'w':
+                network_options.session.max_rollback = std::max(1, std::atoi(optarg));
+                break;
+
+            case 'n':
+                network_options.net_log_interval = std::max(0, std::atoi(optarg));
+                break;
         }
     }
 
+    // nothing to hide when there's no one on the other end
+    if (network_options.mode == Game::NetworkMode::Single)
+        network_options.session.input_delay = 0;
+
+    if (network_options.transport == Game::Transport::Tcp && !network_options.link_conditions.is_perfect())
+        panic("link conditions can only be simulated over UDP\n");
+
     if (!glfwInit())
         panic("glfwInit failed\n");
 
@@ -434,7 +698,6 @@ int main(int argc, char *argv[])
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 5);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-    glfwWindowHint(GLFW_SAMPLES, 16);
     auto *window = glfwCreateWindow(WindowWidth, WindowHeight, "demo", nullptr, nullptr);
     if (!window)
         panic("glfwCreateWindow failed\n");
@@ -444,9 +707,13 @@ int main(int argc, char *argv[])
 
     glewInit();
 
+    ShaderProgram::enable_parallel_compile();
+
     glfwSetKeyCallback(window, [](GLFWwindow *window, int key, int scancode, int action, int mode) {
         if (key == GLFW_KEY_ESCAPE && action == GLFW_PRESS)
             glfwSetWindowShouldClose(window, GL_TRUE);
+        if (key == GLFW_KEY_TAB && action == GLFW_PRESS)
+            g_show_net_stats = !g_show_net_stats;
     });
 
     glViewport(0, 0, WindowWidth, WindowHeight);
@@ -456,24 +723,49 @@ int main(int argc, char *argv[])
 
     {
         cache_tilesheet("resources/tilesheets/sheet.json");
+        cache_tilesheet("resources/tilesheets/font.json");
+        cache_tilesheet("resources/tilesheets/background.json");
         initialize_foe_classes();
         g_sprite_batcher = new SpriteBatcher;
 
         {
-            Game game(mode, host);
+            Game game(network_options, msaa_samples);
+            if (session_path)
+                game.record_session(session_path);
+            game.start();
+
+            // sprite batch stats of every frame
+            std::ofstream stats_file;
+            if (stats_path)
+            {
+                stats_file.open(stats_path);
+                if (!stats_file)
+                    panic("failed to open %s\n", stats_path);
+                RenderStats::write_csv_header(stats_file, 2);
+            }
 
-            while (!glfwWindowShouldClose(window))
+            bool first_frame = true;
+            while (!glfwWindowShouldClose(window) && game.running())
             {
                 update_dpad_state(window);
 
                 glClearColor(0, 0, 0, 0);
                 glClear(GL_COLOR_BUFFER_BIT);
 
-                if (!game.advance(1000.f / 60.f))
-                    break;
-
                 game.render();
 
+                if (stats_file.is_open())
+                    g_sprite_batcher->stats().write_csv(stats_file);
+
+                if (first_frame)
+                {
+                    // by now every program has been used, so any parallel compiles have finished
+                    const auto &stats = ShaderProgram::startup_stats();
+                    std::cout << "shaders: " << stats.programs << " programs (" << stats.cache_hits << " from cache) in "
+                              << stats.milliseconds << " ms\n";
+                    first_frame = false;
+                }
+
                 glfwSwapBuffers(window);
                 glfwPollEvents();
             }
@@ -0,0 +1,646 @@
+#include "matchserver.h"
+
+#include "panic.h"
+#include "gameconstants.h"
+
+#include <algorithm>
+#include <cassert>
+
+namespace
+{
+constexpr auto ResendInterval = std::chrono::milliseconds(30); // if nothing new was sent in between
+constexpr auto IdleTimeout = std::chrono::seconds(3);
+constexpr auto MaxCatchUpTics = 8; // per player per tic, when their input arrived in a burst
+constexpr auto KeyframeInterval = 60; // tics
+constexpr auto SpectatorDataHeaderSize = 1 + 4 + 2 + 2 * 2; // type, session id, seq, a size for each snapshot
+constexpr auto WelcomeLifetime = std::chrono::seconds(60);
+constexpr auto LobbyTimerInterval = std::chrono::seconds(10);
+}
+
+MatchWorker::Player::Player(const Level *level)
+    : world(ViewportWidth, ViewportHeight)
+{
+    world.initialize_level(level);
+}
+
+MatchWorker::Match::Match(const Level *level)
+    : players{Player(level), Player(level)}
+{
+}
+
+MatchWorker::MatchWorker(const Level *level, int port, std::function<void(uint32_t match_id)> match_ended)
+    : level_(level)
+    , port_(port)
+    , match_ended_(std::move(match_ended))
+    , socket_(io_context_, boost::asio::ip::udp::endpoint(boost::asio::ip::udp::v4(), port))
+    , timer_(io_context_)
+    , receive_buffer_(MaxPacketSize)
+{
+}
+
+MatchWorker::~MatchWorker()
+{
+    io_context_.stop();
+    if (thread_.joinable())
+        thread_.join();
+}
+
+void MatchWorker::start()
+{
+    do_receive();
+    tic_time_ = Clock::now();
+    start_timer();
+    thread_ = std::thread([this] { io_context_.run(); });
+}
+
+void MatchWorker::add_player(uint32_t match_id, int slot, const boost::asio::ip::udp::endpoint &endpoint,
+                             uint32_t session_id)
+{
+    io_context_.post(
+        [this, match_id, slot, endpoint, session_id]
+        {
+            auto it = matches_.find(match_id);
+            if (it == matches_.end())
+            {
+                // the first player left before the lobby heard about it; if this beats the Welcome the client
+                // ignores it and times out instead
+                if (slot != 0)
+                {
+                    send_disconnect(endpoint, session_id);
+                    return;
+                }
+                it = matches_.emplace(match_id, std::make_unique<Match>(level_)).first;
+                stats_.matches = matches_.size();
+            }
+
+            auto &player = it->second->players[slot];
+            player.joined = true;
+            player.endpoint = endpoint;
+            player.channel.set_session_id(session_id);
+            player.channel.touch();
+            players_[endpoint] = {it->second.get(), slot};
+        });
+}
+
+void MatchWorker::add_spectator(uint32_t match_id, const boost::asio::ip::udp::endpoint &endpoint,
+                                uint32_t session_id)
+{
+    io_context_.post(
+        [this, match_id, endpoint, session_id]
+        {
+            auto it = matches_.find(match_id);
+            if (it == matches_.end() || spectators_.count(endpoint))
+                return;
+
+            auto &match = *it->second;
+            match.spectators.push_back({endpoint, session_id, Clock::now()});
+            match.tics_to_keyframe = 0;
+            spectators_[endpoint] = &match;
+        });
+}
+
+void MatchWorker::do_receive()
+{
+    socket_.async_receive_from(boost::asio::buffer(receive_buffer_), sender_endpoint_,
+        [this](boost::system::error_code ec, std::size_t bytes_transferred)
+        {
+            if (ec == boost::asio::error::operation_aborted)
+                return;
+
+            if (!ec)
+            {
+                const auto start = Clock::now();
+                handle_packet(bytes_transferred);
+                add_busy_time(start);
+            }
+
+            do_receive();
+        });
+}
+
+void MatchWorker::handle_packet(std::size_t size)
+{
+    PacketReader reader(receive_buffer_.data(), size);
+
+    uint8_t type;
+    if (!reader.get_u8(type))
+        return;
+
+    switch (static_cast<PacketType>(type))
+    {
+        case PacketType::Data:
+            handle_data(reader);
+            break;
+
+        case PacketType::Spectate:
+            handle_spectate(reader);
+            break;
+
+        default:
+            break;
+    }
+}
+
+void MatchWorker::handle_data(PacketReader &reader)
+{
+    auto it = players_.find(sender_endpoint_);
+    if (it == players_.end())
+        return;
+    auto &[match, slot] = it->second;
+
+    received_messages_.clear();
+    if (!match->players[slot].channel.read_data(reader, received_messages_))
+        return;
+
+    handle_messages(*match, slot);
+}
+
+void MatchWorker::handle_messages(Match &match, int slot)
+{
+    auto &player = match.players[slot];
+    auto &other = match.players[1 - slot];
+
+    for (const auto &message : received_messages_)
+    {
+        switch (message.type)
+        {
+            case Message::Type::Input:
+                if (!player.have_input)
+                {
+                    player.next_input_tic = message.tic;
+                    player.have_input = true;
+                }
+                player.inputs.push_back(message.value);
+                break;
+
+            case Message::Type::Checksum:
+                player.checksums.emplace_back(message.tic, message.value);
+                break;
+
+            case Message::Type::Desync:
+            case Message::Type::TimeSync:
+            case Message::Type::Ping:
+            case Message::Type::Pong:
+                // between the players only; the round trip they measure includes the hop through here
+                break;
+        }
+
+        // input is queued up until the other player joins, anything else is only worth passing on right away
+        if (message.type == Message::Type::Input || other.joined)
+            other.channel.queue_message(message);
+    }
+
+    if (!received_messages_.empty() && other.joined)
+        send_data(other);
+}
+
+// a spectator saying it's still there
+void MatchWorker::handle_spectate(PacketReader &reader)
+{
+    auto it = spectators_.find(sender_endpoint_);
+    if (it == spectators_.end())
+        return;
+
+    uint32_t magic, session_id;
+    uint8_t version;
+    if (!reader.get_u32(magic) || magic != ProtocolMagic || !reader.get_u8(version) ||
+        version != ProtocolVersion || !reader.get_u32(session_id))
+        return;
+
+    for (auto &spectator : it->second->spectators)
+    {
+        if (spectator.endpoint == sender_endpoint_ && spectator.session_id == session_id)
+            spectator.last_receive_time = Clock::now();
+    }
+}
+
+void MatchWorker::send_data(Player &player)
+{
+    writer_.clear();
+    player.channel.write_data(writer_);
+
+    boost::system::error_code ignored_error;
+    socket_.send_to(boost::asio::buffer(writer_.data()), player.endpoint, 0, ignored_error);
+}
+
+void MatchWorker::start_timer()
+{
+    timer_.expires_at(tic_time_);
+    timer_.async_wait(
+        [this](boost::system::error_code ec)
+        {
+            if (!ec)
+                handle_tic();
+        });
+}
+
+void MatchWorker::handle_tic()
+{
+    const auto start = Clock::now();
+
+    ++stats_.tics;
+    if (start - tic_time_ > TicDuration)
+    {
+        ++stats_.late_tics;
+        tic_time_ = start; // don't try to make up for it
+    }
+
+    auto it = matches_.begin();
+    while (it != matches_.end())
+    {
+        auto &match = *it->second;
+
+        // without them the other player would stall at max_rollback forever, or wait for an opponent forever
+        const auto left = std::any_of(match.players.begin(), match.players.end(),
+                                      [start](const Player &player)
+                                      {
+                                          return player.joined &&
+                                                 start - player.channel.last_receive_time() > IdleTimeout;
+                                      });
+        if (left)
+        {
+            end_match(it++);
+            continue;
+        }
+
+        for (auto &player : match.players)
+        {
+            if (!player.joined)
+                continue;
+
+            simulate(player);
+
+            // keeps acks flowing and resends input while the player is stalled
+            if (start - player.channel.last_send_time() > ResendInterval)
+                send_data(player);
+        }
+
+        update_spectators(match, start);
+        ++it;
+    }
+    stats_.matches = matches_.size();
+
+    tic_time_ += TicDuration;
+    start_timer();
+
+    add_busy_time(start);
+}
+
+void MatchWorker::simulate(Player &player)
+{
+    for (int i = 0; i < MaxCatchUpTics; ++i)
+    {
+        // no input during the player's input delay, before the first they sent
+        const uint32_t tic = player.world.tic() + 1;
+        if (!player.have_input || tic >= player.next_input_tic + player.inputs.size())
+            break;
+
+        unsigned dpad_state = 0;
+        if (tic >= player.next_input_tic)
+        {
+            assert(tic == player.next_input_tic);
+            dpad_state = player.inputs.front();
+            player.inputs.pop_front();
+            ++player.next_input_tic;
+        }
+        player.world.advance(dpad_state);
+
+        while (!player.checksums.empty() && player.checksums.front().first <= tic)
+        {
+            const auto [checksum_tic, value] = player.checksums.front();
+            if (checksum_tic == tic && value != player.world.wire_checksum())
+                ++stats_.desyncs;
+            player.checksums.pop_front();
+        }
+    }
+}
+
+void MatchWorker::update_spectators(Match &match, Clock::time_point now)
+{
+    auto &spectators = match.spectators;
+    auto it = spectators.begin();
+    while (it != spectators.end())
+    {
+        if (now - it->last_receive_time > IdleTimeout)
+        {
+            spectators_.erase(it->endpoint);
+            it = spectators.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+    if (spectators.empty())
+        return;
+
+    const auto keyframe = match.tics_to_keyframe == 0;
+    if (!keyframe && match.players[0].world.tic() == match.spectator_tics[0] &&
+        match.players[1].world.tic() == match.spectator_tics[1])
+        return; // nothing new, waiting for input
+    match.tics_to_keyframe = keyframe ? KeyframeInterval - 1 : match.tics_to_keyframe - 1;
+
+    std::size_t size = SpectatorDataHeaderSize;
+    for (int i = 0; i < 2; ++i)
+    {
+        const auto &world = match.players[i].world;
+        auto &writer = snapshot_writers_[i];
+        writer.clear();
+        if (keyframe || world.tic() != match.spectator_tics[i])
+        {
+            world.snapshot(snapshot_);
+            match.spectator_codecs[i].encode(snapshot_, keyframe, writer);
+            match.spectator_tics[i] = world.tic();
+
+            if (SpectatorDataHeaderSize + writer.data().size() > MaxPacketSize)
+            {
+                // Doesn't fit even on its own. The gap in seq makes the spectators drop what they have and
+                // wait for a keyframe, which comes right away.
+                ++match.spectator_seq;
+                match.tics_to_keyframe = 0;
+                return;
+            }
+        }
+        size += writer.data().size();
+    }
+
+    if (size <= MaxPacketSize)
+    {
+        send_spectator_data(match, -1);
+    }
+    else
+    {
+        send_spectator_data(match, 0);
+        send_spectator_data(match, 1);
+    }
+}
+
+// the snapshot of world, or -1 for both; the other one goes out empty, as if that world hadn't advanced
+void MatchWorker::send_spectator_data(Match &match, int world)
+{
+    spectator_writer_.clear();
+    spectator_writer_.put_u16(match.spectator_seq++);
+    for (int i = 0; i < 2; ++i)
+    {
+        const auto &data = snapshot_writers_[i].data();
+        if (world == -1 || world == i)
+        {
+            spectator_writer_.put_u16(data.size());
+            spectator_writer_.put_bytes(data);
+        }
+        else
+        {
+            spectator_writer_.put_u16(0);
+        }
+    }
+    assert(1 + 4 + spectator_writer_.data().size() <= MaxPacketSize);
+
+    for (const auto &spectator : match.spectators)
+    {
+        writer_.clear();
+        writer_.put_u8(static_cast<uint8_t>(PacketType::SpectatorData));
+        writer_.put_u32(spectator.session_id);
+        writer_.put_bytes(spectator_writer_.data());
+
+        boost::system::error_code ignored_error;
+        socket_.send_to(boost::asio::buffer(writer_.data()), spectator.endpoint, 0, ignored_error);
+    }
+}
+
+void MatchWorker::end_match(std::map<uint32_t, std::unique_ptr<Match>>::iterator it)
+{
+    const auto &match = *it->second;
+    for (const auto &player : match.players)
+    {
+        if (!player.joined)
+            continue;
+        send_disconnect(player.endpoint, player.channel.session_id());
+        players_.erase(player.endpoint);
+    }
+    for (const auto &spectator : match.spectators)
+    {
+        send_disconnect(spectator.endpoint, spectator.session_id);
+        spectators_.erase(spectator.endpoint);
+    }
+
+    const auto match_id = it->first;
+    matches_.erase(it);
+    match_ended_(match_id);
+}
+
+// best effort, anyone who misses it times out
+void MatchWorker::send_disconnect(const boost::asio::ip::udp::endpoint &endpoint, uint32_t session_id)
+{
+    writer_.clear();
+    writer_.put_u8(static_cast<uint8_t>(PacketType::Disconnect));
+    writer_.put_u32(session_id);
+
+    boost::system::error_code ignored_error;
+    socket_.send_to(boost::asio::buffer(writer_.data()), endpoint, 0, ignored_error);
+}
+
+void MatchWorker::add_busy_time(Clock::time_point start)
+{
+    const auto busy = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start);
+    stats_.busy_us.fetch_add(busy.count(), std::memory_order_relaxed);
+}
+
+MatchServer::MatchServer(const Level *level, int port, int workers)
+    : socket_(io_context_, boost::asio::ip::udp::endpoint(boost::asio::ip::udp::v4(), port))
+    , timer_(io_context_)
+    , receive_buffer_(MaxPacketSize)
+{
+    if (workers <= 0)
+        panic("need at least one worker\n");
+
+    for (int i = 0; i < workers; ++i)
+    {
+        workers_.push_back(std::make_unique<MatchWorker>(
+            level, port + 1 + i,
+            [this](uint32_t match_id) { io_context_.post([this, match_id] { handle_match_ended(match_id); }); }));
+    }
+}
+
+void MatchServer::run()
+{
+    for (auto &worker : workers_)
+        worker->start();
+
+    do_receive();
+    start_timer();
+    io_context_.run();
+}
+
+void MatchServer::do_receive()
+{
+    socket_.async_receive_from(boost::asio::buffer(receive_buffer_), sender_endpoint_,
+        [this](boost::system::error_code ec, std::size_t bytes_transferred)
+        {
+            if (ec == boost::asio::error::operation_aborted)
+                return;
+
+            if (!ec)
+                handle_packet(bytes_transferred);
+
+            do_receive();
+        });
+}
+
+void MatchServer::handle_packet(std::size_t size)
+{
+    PacketReader reader(receive_buffer_.data(), size);
+
+    uint8_t type;
+    uint32_t magic;
+    if (!reader.get_u8(type) || !reader.get_u32(magic) || magic != ProtocolMagic)
+        return;
+
+    if (static_cast<PacketType>(type) == PacketType::StatsRequest)
+    {
+        send_stats();
+        return;
+    }
+
+    uint8_t version;
+    uint32_t session_id;
+    if (!reader.get_u8(version) || version != ProtocolVersion || !reader.get_u32(session_id))
+        return;
+
+    // a repeat because the Welcome got lost
+    if (auto it = welcomes_.find(session_id); it != welcomes_.end())
+    {
+        send_welcome(session_id, it->second);
+        return;
+    }
+
+    switch (static_cast<PacketType>(type))
+    {
+        case PacketType::Hello:
+            handle_hello(session_id, reader);
+            break;
+
+        case PacketType::Spectate:
+            handle_spectate(session_id, reader);
+            break;
+
+        default:
+            break;
+    }
+}
+
+void MatchServer::handle_hello(uint32_t session_id, PacketReader &reader)
+{
+    SessionParameters parameters;
+    if (!reader.get_u16(parameters.input_delay) || !reader.get_u16(parameters.max_rollback))
+        return;
+
+    int slot;
+    uint32_t match_id;
+    const auto key = std::make_pair(parameters.input_delay, parameters.max_rollback);
+    if (auto it = waiting_matches_.find(key); it != waiting_matches_.end())
+    {
+        match_id = it->second;
+        slot = 1;
+        waiting_matches_.erase(it);
+        last_full_match_id_ = match_id;
+    }
+    else
+    {
+        match_id = next_match_id_++;
+        slot = 0;
+        waiting_matches_[key] = match_id;
+    }
+
+    const auto worker = worker_for(match_id);
+    workers_[worker]->add_player(match_id, slot, sender_endpoint_, session_id);
+    const auto &welcome = welcomes_[session_id] = {worker, parameters, Clock::now()};
+    send_welcome(session_id, welcome);
+}
+
+void MatchServer::handle_match_ended(uint32_t match_id)
+{
+    // the player waiting for an opponent gave up, the next one starts a new match
+    const auto it = std::find_if(waiting_matches_.begin(), waiting_matches_.end(),
+                                 [match_id](const auto &waiting_match) { return waiting_match.second == match_id; });
+    if (it != waiting_matches_.end())
+        waiting_matches_.erase(it);
+}
+
+void MatchServer::handle_spectate(uint32_t session_id, PacketReader &reader)
+{
+    uint32_t match_id;
+    if (!reader.get_u32(match_id))
+        return;
+    if (match_id == 0)
+        match_id = last_full_match_id_;
+    if (match_id == 0 || match_id >= next_match_id_)
+        return; // nothing to watch (yet)
+
+    const auto worker = worker_for(match_id);
+    workers_[worker]->add_spectator(match_id, sender_endpoint_, session_id);
+    const auto &welcome = welcomes_[session_id] = {worker, {}, Clock::now()};
+    send_welcome(session_id, welcome);
+}
+
+// round robin
+int MatchServer::worker_for(uint32_t match_id) const
+{
+    return (match_id - 1) % workers_.size();
+}
+
+void MatchServer::send_welcome(uint32_t session_id, const Welcome &welcome)
+{
+    PacketWriter writer;
+    writer.put_u8(static_cast<uint8_t>(PacketType::Welcome));
+    writer.put_u32(ProtocolMagic);
+    writer.put_u32(session_id);
+    writer.put_u16(workers_[welcome.worker]->port());
+    writer.put_u16(welcome.parameters.input_delay);
+    writer.put_u16(welcome.parameters.max_rollback);
+
+    boost::system::error_code ignored_error;
+    socket_.send_to(boost::asio::buffer(writer.data()), sender_endpoint_, 0, ignored_error);
+}
+
+void MatchServer::send_stats()
+{
+    PacketWriter writer;
+    writer.put_u8(static_cast<uint8_t>(PacketType::StatsReply));
+    writer.put_u32(ProtocolMagic);
+    writer.put_u8(workers_.size());
+    for (const auto &worker : workers_)
+    {
+        const auto &stats = worker->stats();
+        writer.put_u32(stats.matches);
+        writer.put_u32(stats.tics);
+        writer.put_u32(stats.late_tics);
+        writer.put_u32(stats.busy_us);
+        writer.put_u32(stats.desyncs);
+    }
+
+    boost::system::error_code ignored_error;
+    socket_.send_to(boost::asio::buffer(writer.data()), sender_endpoint_, 0, ignored_error);
+}
+
+void MatchServer::start_timer()
+{
+    timer_.expires_after(LobbyTimerInterval);
+    timer_.async_wait(
+        [this](boost::system::error_code ec)
+        {
+            if (ec)
+                return;
+
+            const auto now = Clock::now();
+            auto it = welcomes_.begin();
+            while (it != welcomes_.end())
+            {
+                if (now - it->second.time > WelcomeLifetime)
+                    it = welcomes_.erase(it);
+                else
+                    ++it;
+            }
+
+            start_timer();
+        });
+}
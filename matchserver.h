@@ -0,0 +1,182 @@
+#pragma once
+
+#include "udpchannel.h"
+#include "packet.h"
+#include "world.h"
+#include "snapshot.h"
+
+#include <boost/asio.hpp>
+#include <boost/noncopyable.hpp>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <thread>
+#include <utility>
+#include <vector>
+
+struct Level;
+
+// Hosts the matches of one core: its own thread, io_context, UDP socket and 60 Hz tic. Input, checksums and
+// desync reports are relayed to the other player as soon as they arrive. On top of that every player's world
+// is simulated here on their confirmed input, and the checksums they send are checked against it. Spectators
+// get those worlds as snapshots, a keyframe every second and deltas in between. A player leaving ends the
+// match, and whoever is still in it gets a Disconnect.
+class MatchWorker : private boost::noncopyable
+{
+public:
+    // match_ended is called on the worker thread with the id of every match that's over
+    MatchWorker(const Level *level, int port, std::function<void(uint32_t match_id)> match_ended);
+    ~MatchWorker();
+
+    void start();
+
+    int port() const { return port_; }
+
+    // from any thread; the player is expected to send from endpoint, with session_id, and gets a Disconnect if
+    // they were meant to be the second player of a match that already ended
+    void add_player(uint32_t match_id, int slot, const boost::asio::ip::udp::endpoint &endpoint,
+                    uint32_t session_id);
+
+    // from any thread; ignored if there's no such match
+    void add_spectator(uint32_t match_id, const boost::asio::ip::udp::endpoint &endpoint, uint32_t session_id);
+
+    // updated on the worker thread, can be read from anywhere
+    struct Stats
+    {
+        std::atomic<uint32_t> matches = 0;
+        std::atomic<uint32_t> tics = 0;
+        std::atomic<uint32_t> late_tics = 0; // started more than a tic late
+        std::atomic<uint32_t> busy_us = 0; // spent handling datagrams and tics, wraps around
+        std::atomic<uint32_t> desyncs = 0; // client checksums that didn't match the simulation here
+    };
+    const Stats &stats() const { return stats_; }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Player
+    {
+        Player(const Level *level);
+
+        bool joined = false;
+        boost::asio::ip::udp::endpoint endpoint;
+        UdpChannel channel; // what's queued for this player
+
+        World world; // this player's local world, on their confirmed input
+        std::deque<uint8_t> inputs; // confirmed, not simulated yet
+        bool have_input = false;
+        uint32_t next_input_tic = 0; // of inputs.front()
+        std::deque<std::pair<uint32_t, uint32_t>> checksums; // tic, value; not checked yet
+    };
+
+    struct Spectator
+    {
+        boost::asio::ip::udp::endpoint endpoint;
+        uint32_t session_id;
+        Clock::time_point last_receive_time;
+    };
+
+    struct Match
+    {
+        Match(const Level *level);
+
+        std::array<Player, 2> players;
+
+        // every spectator gets the same stream, which starts over with a keyframe whenever one joins
+        std::vector<Spectator> spectators;
+        std::array<SnapshotCodec, 2> spectator_codecs;
+        std::array<int, 2> spectator_tics = {-1, -1}; // of the last snapshots coded
+        int tics_to_keyframe = 0;
+        uint16_t spectator_seq = 0;
+    };
+
+    void do_receive();
+    void handle_packet(std::size_t size);
+    void handle_data(PacketReader &reader);
+    void handle_messages(Match &match, int slot);
+    void handle_spectate(PacketReader &reader);
+    void send_data(Player &player);
+    void start_timer();
+    void handle_tic();
+    void simulate(Player &player);
+    void update_spectators(Match &match, Clock::time_point now);
+    void send_spectator_data(Match &match, int world);
+    void end_match(std::map<uint32_t, std::unique_ptr<Match>>::iterator it);
+    void send_disconnect(const boost::asio::ip::udp::endpoint &endpoint, uint32_t session_id);
+    void add_busy_time(Clock::time_point start);
+
+    const Level *level_;
+    int port_;
+    std::function<void(uint32_t match_id)> match_ended_;
+    boost::asio::io_context io_context_;
+    boost::asio::ip::udp::socket socket_;
+    boost::asio::steady_timer timer_;
+    std::thread thread_;
+    Clock::time_point tic_time_;
+
+    std::map<uint32_t, std::unique_ptr<Match>> matches_;
+    std::map<boost::asio::ip::udp::endpoint, std::pair<Match *, int>> players_; // endpoint to match, slot
+    std::map<boost::asio::ip::udp::endpoint, Match *> spectators_;
+
+    boost::asio::ip::udp::endpoint sender_endpoint_;
+    std::vector<uint8_t> receive_buffer_;
+    std::vector<Message> received_messages_;
+    PacketWriter writer_;
+    PacketWriter spectator_writer_; // what every spectator of a match gets after the session id
+    Snapshot snapshot_;
+    std::array<BitWriter, 2> snapshot_writers_; // what each world's spectator codec made of this tic
+    Stats stats_;
+};
+
+// Answers Hellos on one port and pairs clients up into matches, spread round robin over the workers. Only
+// clients with the same SessionParameters are paired. The Welcome tells the client which worker's port to talk
+// to from then on. Also answers StatsRequests.
+// Runs on the calling thread.
+class MatchServer : private boost::noncopyable
+{
+public:
+    // the workers listen on the ports right after port
+    MatchServer(const Level *level, int port, int workers);
+
+    void run();
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Welcome
+    {
+        int worker;
+        SessionParameters parameters; // zero for spectators
+        Clock::time_point time;
+    };
+
+    void do_receive();
+    void handle_packet(std::size_t size);
+    void handle_hello(uint32_t session_id, PacketReader &reader);
+    void handle_spectate(uint32_t session_id, PacketReader &reader);
+    void handle_match_ended(uint32_t match_id);
+    void send_welcome(uint32_t session_id, const Welcome &welcome);
+    int worker_for(uint32_t match_id) const;
+    void send_stats();
+    void start_timer();
+
+    boost::asio::io_context io_context_;
+    boost::asio::ip::udp::socket socket_;
+    boost::asio::steady_timer timer_;
+    std::vector<std::unique_ptr<MatchWorker>> workers_;
+
+    uint32_t next_match_id_ = 1;
+    // one player in, waiting for a second, by input delay and max rollback
+    std::map<std::pair<uint16_t, uint16_t>, uint32_t> waiting_matches_;
+    uint32_t last_full_match_id_ = 0; // for spectators who don't care which match
+    std::map<uint32_t, Welcome> welcomes_; // by session id, for requests resent because the Welcome got lost
+
+    boost::asio::ip::udp::endpoint sender_endpoint_;
+    std::vector<uint8_t> receive_buffer_;
+};
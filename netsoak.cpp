@@ -0,0 +1,387 @@
+#include "panic.h"
+
+#include "tilesheet.h"
+#include "trajectory.h"
+#include "level.h"
+#include "world.h"
+#include "session.h"
+#include "foeclass.h"
+#include "dpadstate.h"
+#include "udpnetwork.h"
+#include "timesync.h"
+#include "scriptedinput.h"
+#include "gameconstants.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+// Two peers in one process, each with its own Session, talking UDP over loopback through a LinkShim that makes
+// the link as bad as asked for. Both play scripted random input at 60 Hz for a while, each on its own clock,
+// which for the client can be made to run fast to see TimeSync pull the two back in step; every tic a peer's
+// local world's checksum is compared against the other peer's remote world once that is confirmed, on top of
+// the periodic checksum exchange the game does. Reports stalls, rollbacks and desyncs, and exits with 1 on any.
+// Also reports what a tic of the simulation costs, and how much of that the checksums are.
+
+namespace
+{
+using Clock = std::chrono::steady_clock;
+
+constexpr auto ConnectTimeout = std::chrono::seconds(5);
+
+// not the game's, so a soak can run next to it
+constexpr auto DefaultPort = 4143;
+
+struct Peer
+{
+    Peer(const char *name, const Level *level, const Session::Settings &settings,
+         const TimeSync::Settings &time_sync_settings, unsigned seed)
+        : name(name)
+        , session(level, ViewportWidth, ViewportHeight, settings)
+        , time_sync(time_sync_settings)
+        , input(seed)
+    {
+    }
+
+    void advance()
+    {
+        network->read_messages([this](const Message &message) {
+            if (message.type == Message::Type::Input)
+                session.add_remote_input({message.tic, message.value});
+            else if (message.type == Message::Type::Checksum)
+                session.add_remote_checksum({message.tic, message.value});
+            else if (message.type == Message::Type::TimeSync)
+                time_sync.add_remote_report(session.tic(), {message.tic, static_cast<int32_t>(message.value)});
+        });
+
+        Session::Input local_input;
+        const auto advanced = session.advance(input.next(), local_input);
+        network->stats().add_tic(advanced);
+        if (advanced)
+        {
+            network->write_message({Message::Type::Input, local_input.tic, local_input.dpad_state});
+            Session::Checksum checksum;
+            if (session.local_checksum(checksum))
+                network->write_message({Message::Type::Checksum, checksum.tic, checksum.value});
+            local_checksums[session.tic()] = session.local().checksum();
+            stall_tics = 0;
+        }
+        else
+        {
+            longest_stall = std::max(longest_stall, ++stall_tics);
+        }
+
+        time_sync.set_rtt(network->rtt());
+        TimeSync::Report report;
+        if (time_sync.report(session.tic(), report))
+            network->write_message({Message::Type::TimeSync, report.tic, static_cast<uint32_t>(report.advantage)});
+        network->flush();
+
+        // the next tic is due after this
+        const auto stretch = time_sync.stretch();
+        if (stretch > 0)
+        {
+            ++stretched_tics;
+            total_stretch += stretch;
+        }
+        tic_time += std::chrono::duration_cast<Clock::duration>(TicDuration * (1 + stretch) / clock_rate);
+        ++tics;
+
+        int tic;
+        if (const auto *state = session.confirmed_remote_state(tic); state && tic > 0)
+            remote_checksums.emplace(tic, state->checksum());
+
+        for (auto &desync : session.take_desyncs())
+            desyncs.push_back(std::move(desync));
+    }
+
+    const char *name;
+    Session session;
+    TimeSync time_sync;
+    ScriptedInput input;
+    std::unique_ptr<UdpNetworkThread> network;
+    std::map<int, uint64_t> local_checksums;
+    std::map<int, uint64_t> remote_checksums; // of the other side's local world, once confirmed
+    std::vector<Session::Desync> desyncs; // found through the checksums the other side sent
+    bool dumped_desync = false;
+    int stall_tics = 0;
+    int longest_stall = 0;
+    float clock_rate = 1; // how fast this peer's clock runs against real time
+    Clock::time_point tic_time;
+    int tics = 0; // including stalled ones
+    int stretched_tics = 0;
+    float total_stretch = 0;
+};
+
+// peer's view of the other side against what the other side actually had, at every tic both have
+int count_desyncs(const Peer &peer, const Peer &other, int &checked)
+{
+    int desyncs = 0;
+    for (const auto &[tic, checksum] : peer.remote_checksums)
+    {
+        auto it = other.local_checksums.find(tic);
+        if (it == other.local_checksums.end())
+            continue;
+        ++checked;
+        if (it->second != checksum)
+        {
+            if (desyncs == 0)
+                std::cout << peer.name << ": first desync at tic " << tic << '\n';
+            ++desyncs;
+        }
+    }
+    return desyncs;
+}
+
+// both halves of the first desync the checksum exchange caught, for diffing, while the other side still has its
+// local state around
+void dump_desyncs(Peer &peer, const Peer &other)
+{
+    if (peer.desyncs.empty() || peer.dumped_desync)
+    {
+        peer.desyncs.clear();
+        return;
+    }
+
+    const auto &desync = peer.desyncs.front();
+    const auto prefix = "desync-" + std::to_string(desync.tic) + "-" + peer.name;
+
+    std::ofstream remote_file(prefix + "-remote.txt");
+    desync.remote_state.dump(remote_file);
+
+    if (const auto *state = other.session.checksummed_local_state(desync.tic))
+    {
+        std::ofstream local_file(prefix + "-expected.txt");
+        state->dump(local_file);
+    }
+
+    std::cout << peer.name << ": dumped desync at tic " << desync.tic << " to " << prefix << "-*.txt\n";
+
+    peer.dumped_desync = true;
+    peer.desyncs.clear();
+}
+
+// Replays the same input through a world with checksums and one without, best of a few rounds each so that
+// neither gets an unfair share of whatever else the machine is doing.
+void report_simulation_cost(const Level *level, unsigned seed, int tics)
+{
+    constexpr auto Rounds = 5;
+
+    World checksummed(ViewportWidth, ViewportHeight);
+    checksummed.initialize_level(level);
+    World plain = checksummed;
+    plain.set_checksums_enabled(false);
+
+    ScriptedInput input(seed);
+    std::vector<unsigned> inputs(tics);
+    std::generate(inputs.begin(), inputs.end(), [&input] { return input.next(); });
+
+    const auto time_per_tic = [&inputs](World world) {
+        const auto start = Clock::now();
+        for (const auto dpad_state : inputs)
+            world.advance(dpad_state);
+        return std::chrono::duration<float, std::micro>(Clock::now() - start) / inputs.size();
+    };
+
+    auto with = std::chrono::duration<float, std::micro>::max();
+    auto without = with;
+    for (int i = 0; i < Rounds; ++i)
+    {
+        with = std::min(with, time_per_tic(checksummed));
+        without = std::min(without, time_per_tic(plain));
+    }
+
+    const auto checksums = std::max(with - without, std::chrono::duration<float, std::micro>::zero());
+    std::cout << "simulation " << with.count() << " us per tic, checksums " << checksums.count() << " us ("
+              << 100 * checksums / with << "% of the simulation, " << 100 * checksums / TicDuration
+              << "% of a tic)\n";
+}
+
+float milliseconds(std::chrono::microseconds duration)
+{
+    return std::chrono::duration<float, std::milli>(duration).count();
+}
+
+void report(const Peer &peer, const NetStats::Sample &start)
+{
+    const auto &stats = peer.session.stats();
+    std::cout << peer.name << ": " << peer.session.tic() << '/' << peer.tics << " tics, " << stats.stalled_tics
+              << " stalled (longest " << peer.longest_stall << "), " << stats.rollbacks << " rollbacks, "
+              << stats.resimulated_tics << " resimulated tics";
+    if (stats.rollbacks)
+        std::cout << " (" << static_cast<float>(stats.resimulated_tics) / stats.rollbacks << " per rollback)";
+    std::cout << '\n';
+    std::cout << "    " << stats.checksums_checked << " checksums checked, " << stats.desyncs << " desyncs\n";
+    const auto net = peer.network->stats().sample();
+    const auto rates = NetStats::rates(start, net);
+    std::cout << "    rtt " << milliseconds(net.rtt_p50) << '/' << milliseconds(net.rtt_p95) << '/'
+              << milliseconds(net.rtt_p99) << " ms (p50/p95/p99), jitter " << milliseconds(net.jitter)
+              << " ms, sent " << rates.bytes_sent_per_second << " B/s, received " << rates.bytes_received_per_second
+              << " B/s, receive queue up to " << net.max_queue_depth << ", " << rates.stall_ms_per_tic
+              << " ms stalled per tic\n";
+    std::cout << "    advantage " << peer.time_sync.advantage() << " tics, " << peer.stretched_tics
+              << " tics stretched";
+    if (peer.stretched_tics)
+        std::cout << " (by " << 100 * peer.total_stretch / peer.stretched_tics << "% on average)";
+    std::cout << '\n';
+
+    if (const auto *shim = peer.network->link_shim())
+    {
+        const auto &link = shim->stats();
+        std::cout << "    sent " << link.sent << " datagrams, dropped " << link.dropped << ", duplicated "
+                  << link.duplicated << ", reordered " << link.reordered << '\n';
+    }
+}
+}
+
+static void usage(const char *argv0)
+{
+    std::cerr << "usage: " << argv0
+              << " [-t seconds] [-l latency=ms,jitter=ms,loss=p,duplicate=p,reorder=p] [-d input_delay] "
+                 "[-w max_rollback] [-c client_clock_drift_percent] [-n] [-r seed] [-p port]\n";
+    std::exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+    int seconds = 60;
+    LinkConditions conditions;
+    Session::Settings settings;
+    TimeSync::Settings time_sync_settings;
+    float drift = 0;
+    unsigned seed = 1;
+    int port = DefaultPort;
+
+    int c;
+    while ((c = getopt(argc, argv, "t:l:d:w:c:nr:p:")) != EOF)
+    {
+        switch (c)
+        {
+            case 't':
+                seconds = std::atoi(optarg);
+                break;
+
+            case 'l':
+                if (!conditions.parse(optarg))
+                    usage(argv[0]);
+                break;
+
+            case 'd':
+                settings.input_delay = std::max(0, std::atoi(optarg));
+                break;
+
+            case 'w':
+                settings.max_rollback = std::max(1, std::atoi(optarg));
+                break;
+
+            case 'c':
+                drift = std::atof(optarg);
+                break;
+
+            case 'n':
+                time_sync_settings.max_stretch = 0;
+                break;
+
+            case 'r':
+                seed = std::strtoul(optarg, nullptr, 10);
+                break;
+
+            case 'p':
+                port = std::atoi(optarg);
+                break;
+
+            default:
+                usage(argv[0]);
+        }
+    }
+
+    if (seconds <= 0 || drift <= -100)
+        usage(argv[0]);
+
+    cache_tilesheet("resources/tilesheets/sheet.json");
+    initialize_foe_classes();
+
+    int desyncs = 0;
+
+    {
+        const auto level = load_level("resources/levels/level-0.json");
+
+        Peer server("server", level.get(), settings, time_sync_settings, seed);
+        Peer client("client", level.get(), settings, time_sync_settings, seed + 1);
+        client.clock_rate = 1 + drift / 100;
+
+        server.network = std::make_unique<UdpServerNetworkThread>(port);
+        client.network = std::make_unique<UdpClientNetworkThread>("127.0.0.1", std::to_string(port));
+        if (!conditions.is_perfect())
+        {
+            server.network->set_link_conditions(conditions, seed);
+            client.network->set_link_conditions(conditions, seed + 1);
+        }
+        const SessionParameters parameters = {static_cast<uint16_t>(settings.input_delay),
+                                              static_cast<uint16_t>(settings.max_rollback)};
+        server.network->set_session_parameters(parameters);
+        client.network->set_session_parameters(parameters);
+        server.network->start();
+        client.network->start();
+
+        const auto connect_start = Clock::now();
+        while (server.network->status() != NetworkThread::Status::Connected ||
+               client.network->status() != NetworkThread::Status::Connected)
+        {
+            if (Clock::now() - connect_start > ConnectTimeout)
+                panic("peers failed to connect\n");
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+
+        const auto server_start = server.network->stats().sample();
+        const auto client_start = client.network->stats().sample();
+        const auto start_time = Clock::now();
+        const auto end_time = start_time + std::chrono::seconds(seconds);
+        server.tic_time = client.tic_time = start_time;
+        while (true)
+        {
+            if (server.network->status() == NetworkThread::Status::Disconnected ||
+                client.network->status() == NetworkThread::Status::Disconnected)
+                panic("peers disconnected at tic %d\n", server.session.tic());
+
+            const auto now = Clock::now();
+            if (now >= end_time)
+                break;
+
+            for (auto *peer : {&server, &client})
+            {
+                if (now >= peer->tic_time)
+                    peer->advance();
+            }
+
+            dump_desyncs(server, client);
+            dump_desyncs(client, server);
+
+            std::this_thread::sleep_until(std::min(server.tic_time, client.tic_time));
+        }
+
+        int checked = 0;
+        desyncs = count_desyncs(server, client, checked) + count_desyncs(client, server, checked);
+
+        report(server, server_start);
+        report(client, client_start);
+        std::cout << checked << " tics checked in process, " << desyncs << " desyncs\n";
+        report_simulation_cost(level.get(), seed, seconds * TicsPerSecond);
+
+        desyncs += server.session.stats().desyncs + client.session.stats().desyncs;
+    }
+
+    release_tilesheets();
+
+    return desyncs ? 1 : 0;
+}
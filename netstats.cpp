@@ -0,0 +1,132 @@
+#include "netstats.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <vector>
+
+namespace
+{
+constexpr auto RttSmoothing = 8; // like TCP, each sample moves the estimate by an eighth
+constexpr auto JitterSmoothing = 16; // like RTP
+
+std::chrono::microseconds percentile(const std::vector<uint32_t> &sorted, float p)
+{
+    if (sorted.empty())
+        return std::chrono::microseconds(0);
+    const auto index = static_cast<std::size_t>(p * (sorted.size() - 1) + 0.5f);
+    return std::chrono::microseconds(sorted[index]);
+}
+}
+
+void NetStats::add_rtt_sample(std::chrono::microseconds rtt)
+{
+    const auto sample = static_cast<int32_t>(std::max<int64_t>(rtt.count(), 1));
+
+    const auto count = rtt_sample_count_.load(std::memory_order_relaxed);
+    if (count > 0)
+    {
+        const auto &previous_sample = rtt_samples_[(count - 1) % RttWindow];
+        const auto previous = static_cast<int32_t>(previous_sample.load(std::memory_order_relaxed));
+        const auto jitter = static_cast<int32_t>(jitter_us_.load(std::memory_order_relaxed));
+        const auto deviation = std::abs(sample - previous);
+        jitter_us_.store(jitter + (deviation - jitter) / JitterSmoothing, std::memory_order_relaxed);
+
+        const auto smoothed = static_cast<int32_t>(rtt_us_.load(std::memory_order_relaxed));
+        rtt_us_.store(smoothed + (sample - smoothed) / RttSmoothing, std::memory_order_relaxed);
+    }
+    else
+    {
+        rtt_us_.store(sample, std::memory_order_relaxed);
+    }
+
+    rtt_samples_[count % RttWindow].store(sample, std::memory_order_relaxed);
+    rtt_sample_count_.store(count + 1, std::memory_order_release);
+}
+
+void NetStats::add_sent(std::size_t bytes)
+{
+    bytes_sent_.fetch_add(bytes, std::memory_order_relaxed);
+    packets_sent_.fetch_add(1, std::memory_order_relaxed);
+}
+
+void NetStats::add_received(std::size_t bytes)
+{
+    bytes_received_.fetch_add(bytes, std::memory_order_relaxed);
+    packets_received_.fetch_add(1, std::memory_order_relaxed);
+}
+
+void NetStats::set_queue_depth(std::size_t depth)
+{
+    queue_depth_.store(depth, std::memory_order_relaxed);
+    if (static_cast<int>(depth) > max_queue_depth_.load(std::memory_order_relaxed))
+        max_queue_depth_.store(depth, std::memory_order_relaxed);
+}
+
+void NetStats::add_tic(bool advanced)
+{
+    const auto now = Clock::now();
+    if (!advanced && !stalled_)
+    {
+        stalled_ = true;
+        stall_start_ = now;
+    }
+    else if (advanced && stalled_)
+    {
+        stalled_ = false;
+        const auto stall = std::chrono::duration_cast<std::chrono::microseconds>(now - stall_start_);
+        stall_us_.fetch_add(stall.count(), std::memory_order_relaxed);
+    }
+
+    tics_.fetch_add(1, std::memory_order_relaxed);
+    if (!advanced)
+        stalled_tics_.fetch_add(1, std::memory_order_relaxed);
+}
+
+NetStats::Sample NetStats::sample() const
+{
+    Sample sample;
+    sample.time = Clock::now();
+
+    // a sample overwritten while copying is just a newer one, which is fine for percentiles
+    const auto count = rtt_sample_count_.load(std::memory_order_acquire);
+    std::vector<uint32_t> rtts(std::min<uint32_t>(count, RttWindow));
+    for (std::size_t i = 0; i < rtts.size(); ++i)
+        rtts[i] = rtt_samples_[i].load(std::memory_order_relaxed);
+    std::sort(rtts.begin(), rtts.end());
+
+    sample.rtt = rtt();
+    sample.rtt_p50 = percentile(rtts, 0.5f);
+    sample.rtt_p95 = percentile(rtts, 0.95f);
+    sample.rtt_p99 = percentile(rtts, 0.99f);
+    sample.jitter = std::chrono::microseconds(jitter_us_.load(std::memory_order_relaxed));
+    sample.bytes_sent = bytes_sent_.load(std::memory_order_relaxed);
+    sample.bytes_received = bytes_received_.load(std::memory_order_relaxed);
+    sample.packets_sent = packets_sent_.load(std::memory_order_relaxed);
+    sample.packets_received = packets_received_.load(std::memory_order_relaxed);
+    sample.queue_depth = queue_depth_.load(std::memory_order_relaxed);
+    sample.max_queue_depth = max_queue_depth_.load(std::memory_order_relaxed);
+    sample.tics = tics_.load(std::memory_order_relaxed);
+    sample.stalled_tics = stalled_tics_.load(std::memory_order_relaxed);
+    sample.stall_time = std::chrono::microseconds(stall_us_.load(std::memory_order_relaxed));
+    return sample;
+}
+
+NetStats::Rates NetStats::rates(const Sample &from, const Sample &to)
+{
+    Rates rates = {0, 0, 0};
+
+    const auto seconds = std::chrono::duration<float>(to.time - from.time).count();
+    if (seconds > 0)
+    {
+        rates.bytes_sent_per_second = (to.bytes_sent - from.bytes_sent) / seconds;
+        rates.bytes_received_per_second = (to.bytes_received - from.bytes_received) / seconds;
+    }
+
+    if (const auto tics = to.tics - from.tics; tics > 0)
+    {
+        const auto stall_time = std::chrono::duration<float, std::milli>(to.stall_time - from.stall_time);
+        rates.stall_ms_per_tic = stall_time.count() / tics;
+    }
+
+    return rates;
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <boost/noncopyable.hpp>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+// What a connection looks like. Every counter has a single writer, the network thread for the link and the
+// game thread for stalls, and can be read from anywhere without locks.
+class NetStats : private boost::noncopyable
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr int RttWindow = 128; // samples the percentiles are over, half a minute of pings
+
+    // network thread
+    void add_rtt_sample(std::chrono::microseconds rtt);
+    void add_sent(std::size_t bytes);
+    void add_received(std::size_t bytes);
+    void set_queue_depth(std::size_t depth); // of the receive queue, right after a push
+
+    // game thread, once per tic; a stall lasts from the first tic that couldn't advance to the next one that could
+    void add_tic(bool advanced);
+
+    // smoothed, zero until the first sample
+    std::chrono::microseconds rtt() const { return std::chrono::microseconds(rtt_us_.load()); }
+
+    // everything at one point, from any thread
+    struct Sample
+    {
+        Clock::time_point time;
+        std::chrono::microseconds rtt;
+        std::chrono::microseconds rtt_p50;
+        std::chrono::microseconds rtt_p95;
+        std::chrono::microseconds rtt_p99;
+        std::chrono::microseconds jitter; // mean difference between consecutive RTT samples, smoothed
+        uint64_t bytes_sent;
+        uint64_t bytes_received;
+        uint64_t packets_sent;
+        uint64_t packets_received;
+        int queue_depth;
+        int max_queue_depth;
+        int tics;
+        int stalled_tics;
+        std::chrono::microseconds stall_time;
+    };
+    Sample sample() const;
+
+    // between two samples
+    struct Rates
+    {
+        float bytes_sent_per_second;
+        float bytes_received_per_second;
+        float stall_ms_per_tic;
+    };
+    static Rates rates(const Sample &from, const Sample &to);
+
+private:
+    // network thread
+    std::array<std::atomic<uint32_t>, RttWindow> rtt_samples_ = {}; // microseconds, by count % RttWindow
+    std::atomic<uint32_t> rtt_sample_count_ = 0;
+    std::atomic<uint32_t> rtt_us_ = 0;
+    std::atomic<uint32_t> jitter_us_ = 0;
+    std::atomic<uint64_t> bytes_sent_ = 0;
+    std::atomic<uint64_t> bytes_received_ = 0;
+    std::atomic<uint64_t> packets_sent_ = 0;
+    std::atomic<uint64_t> packets_received_ = 0;
+    std::atomic<int> queue_depth_ = 0;
+    std::atomic<int> max_queue_depth_ = 0;
+
+    // game thread
+    std::atomic<int> tics_ = 0;
+    std::atomic<int> stalled_tics_ = 0;
+    std::atomic<int64_t> stall_us_ = 0;
+    bool stalled_ = false;
+    Clock::time_point stall_start_;
+};
@@ -0,0 +1,224 @@
+#include "network.h"
+
+#include <iostream>
+
+namespace
+{
+constexpr auto ReadQueueCapacity = 1024; // the game drains it every tic
+constexpr auto PingInterval = std::chrono::milliseconds(250);
+constexpr auto MaxRtt = std::chrono::seconds(5); // anything longer is garbage
+
+uint32_t ping_clock()
+{
+    const auto now = std::chrono::steady_clock::now().time_since_epoch();
+    return std::chrono::duration_cast<std::chrono::microseconds>(now).count();
+}
+}
+
+NetworkThread::NetworkThread()
+    : read_queue_(ReadQueueCapacity)
+    , ping_timer_(io_context_)
+{
+}
+
+NetworkThread::~NetworkThread()
+{
+    stop();
+}
+
+void NetworkThread::start()
+{
+    do_connect(); // XXX probably should do this without inheritance
+    start_ping_timer();
+    thread_ = std::thread([this] { io_context_.run(); });
+}
+
+void NetworkThread::stop()
+{
+    io_context_.stop();
+    if (thread_.joinable())
+        thread_.join();
+}
+
+void NetworkThread::write_message(const Message &message)
+{
+    io_context_.post([this, message] { send_message(message); });
+}
+
+void NetworkThread::flush()
+{
+    io_context_.post([this] { flush_messages(); });
+}
+
+bool NetworkThread::read_message(Message &message)
+{
+    return read_queue_.try_pop(message);
+}
+
+void NetworkThread::handle_message(const Message &message)
+{
+    switch (message.type)
+    {
+        case Message::Type::Ping:
+            send_message({Message::Type::Pong, 0, message.value});
+            flush_messages();
+            break;
+
+        case Message::Type::Pong:
+        {
+            // the clock wraps around every hour or so, which doesn't matter for the difference
+            const auto sample = static_cast<int32_t>(ping_clock() - message.value);
+            if (sample < 0 || sample > std::chrono::duration_cast<std::chrono::microseconds>(MaxRtt).count())
+                break;
+            stats_.add_rtt_sample(std::chrono::microseconds(sample));
+            break;
+        }
+
+        default:
+            read_queue_.push(message);
+            stats_.set_queue_depth(read_queue_.size());
+            break;
+    }
+}
+
+bool NetworkThread::check_session_parameters(const SessionParameters &remote)
+{
+    if (remote == session_parameters_)
+        return true;
+
+    std::cerr << "the other side runs with input delay " << remote.input_delay << " and max rollback "
+              << remote.max_rollback << ", this one with " << session_parameters_.input_delay << " and "
+              << session_parameters_.max_rollback << '\n';
+    status_ = Status::Disconnected;
+    return false;
+}
+
+void NetworkThread::start_ping_timer()
+{
+    ping_timer_.expires_after(PingInterval);
+    ping_timer_.async_wait(
+        [this](boost::system::error_code ec)
+        {
+            if (ec || status_ == Status::Disconnected)
+                return;
+            if (status_ == Status::Connected)
+            {
+                send_message({Message::Type::Ping, 0, ping_clock()});
+                flush_messages();
+            }
+            start_ping_timer();
+        });
+}
+
+TcpNetworkThread::TcpNetworkThread()
+    : socket_(io_context_)
+{
+}
+
+void TcpNetworkThread::send_message(const Message &message)
+{
+    boost::system::error_code ignored_error;
+    boost::asio::write(socket_, boost::asio::buffer(&message, sizeof(message)), ignored_error);
+    stats_.add_sent(sizeof(message));
+}
+
+void TcpNetworkThread::handle_connected(boost::system::error_code ec)
+{
+    if (!ec)
+    {
+        boost::asio::ip::tcp::no_delay option(true);
+        socket_.set_option(option);
+
+        boost::system::error_code ignored_error;
+        boost::asio::write(socket_, boost::asio::buffer(&session_parameters_, sizeof(session_parameters_)),
+                           ignored_error);
+        stats_.add_sent(sizeof(session_parameters_));
+
+        do_read_session_parameters();
+    }
+    else
+    {
+        status_ = Status::Disconnected;
+    }
+}
+
+void TcpNetworkThread::do_read_session_parameters()
+{
+    boost::asio::async_read(socket_,
+        boost::asio::buffer(&remote_session_parameters_, sizeof(remote_session_parameters_)),
+        [this](boost::system::error_code ec, std::size_t bytes_transferred)
+        {
+            if (!ec)
+            {
+                stats_.add_received(bytes_transferred);
+                if (check_session_parameters(remote_session_parameters_))
+                {
+                    status_ = Status::Connected;
+                    do_read();
+                    return;
+                }
+            }
+
+            socket_.close();
+            status_ = Status::Disconnected;
+        });
+}
+
+void TcpNetworkThread::do_read()
+{
+    boost::asio::async_read(socket_,
+        boost::asio::buffer(&read_message_, sizeof(read_message_)),
+        [this](boost::system::error_code ec, std::size_t bytes_transferred)
+        {
+            if (!ec)
+            {
+                stats_.add_received(bytes_transferred);
+                handle_message(read_message_);
+                do_read();
+            }
+            else
+            {
+                socket_.close();
+                status_ = Status::Disconnected;
+            }
+        });
+}
+
+TcpServerNetworkThread::TcpServerNetworkThread(int port)
+    : acceptor_(io_context_, boost::asio::ip::tcp::endpoint(boost::asio::ip::tcp::v4(), port))
+{
+}
+
+TcpServerNetworkThread::~TcpServerNetworkThread()
+{
+    stop();
+}
+
+void TcpServerNetworkThread::do_connect()
+{
+    acceptor_.async_accept(socket_,
+        [this](boost::system::error_code ec)
+        {
+            handle_connected(ec);
+        });
+}
+
+TcpClientNetworkThread::TcpClientNetworkThread(std::string_view host, std::string_view service)
+{
+    boost::asio::ip::tcp::resolver resolver(io_context_);
+    endpoint_iterator_ = resolver.resolve(host, service);
+}
+
+TcpClientNetworkThread::~TcpClientNetworkThread()
+{
+    stop();
+}
+
+void TcpClientNetworkThread::do_connect()
+{
+    boost::asio::async_connect(socket_, endpoint_iterator_,
+        [this](boost::system::error_code ec, boost::asio::ip::tcp::resolver::iterator)
+        {
+            handle_connected(ec);
+        });
+}
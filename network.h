@@ -0,0 +1,155 @@
+#pragma once
+
+#include "spscqueue.h"
+#include "netstats.h"
+
+#include <boost/asio.hpp>
+#include <boost/noncopyable.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string_view>
+#include <thread>
+#include <utility>
+
+struct Message
+{
+    enum class Type : uint32_t
+    {
+        Input, // value is the dpad state for tic
+        Checksum, // value is the sender's local world checksum after tic, folded to 32 bits
+        Desync, // the sender's checksum for tic didn't match
+        TimeSync, // tic is the sender's tic, value its local advantage (see TimeSync), signed
+        Ping, // value is the sender's clock in microseconds, answered with a Pong by the network thread
+        Pong, // value is the Ping's
+    };
+
+    Type type;
+    uint32_t tic;
+    uint32_t value;
+};
+
+// What the two sides' Sessions have to agree on. Exchanged while connecting, and if they differ the connection
+// fails, instead of the match desyncing later.
+struct SessionParameters
+{
+    uint16_t input_delay = 0;
+    uint16_t max_rollback = 0;
+};
+
+inline bool operator==(const SessionParameters &lhs, const SessionParameters &rhs)
+{
+    return lhs.input_delay == rhs.input_delay && lhs.max_rollback == rhs.max_rollback;
+}
+
+// Connection to the other player, serviced by its own thread. Input messages have to be written in tic
+// order and are delivered in tic order; anything else may get lost on unreliable transports. Transports that
+// batch messages send them on flush(), or a few milliseconds later if nobody calls it. Pings go out a few
+// times a second and are answered right on the network thread, the game never sees them.
+class NetworkThread : private boost::noncopyable
+{
+public:
+    virtual ~NetworkThread();
+
+    void start();
+
+    // has to be called before start()
+    void set_session_parameters(const SessionParameters &parameters) { session_parameters_ = parameters; }
+
+    void write_message(const Message &message);
+    void flush(); // once per tic, after writing its messages
+    bool read_message(Message &message); // false if there's nothing to read right now
+
+    // hands every message received so far to f, returns how many there were
+    template<typename F>
+    std::size_t read_messages(F &&f)
+    {
+        return read_queue_.drain(std::forward<F>(f));
+    }
+
+    enum class Status
+    {
+        Connecting,
+        Connected,
+        Disconnected,
+    };
+
+    Status status() const { return status_; }
+
+    // round trip to the other side's network thread, smoothed; zero until the first Pong
+    std::chrono::microseconds rtt() const { return stats_.rtt(); }
+
+    // the game thread adds its stalls
+    const NetStats &stats() const { return stats_; }
+    NetStats &stats() { return stats_; }
+
+protected:
+    NetworkThread();
+
+    virtual void do_connect() = 0;
+    virtual void send_message(const Message &message) = 0; // on the network thread
+    virtual void flush_messages() {} // same
+
+    // what subclasses do with every message received
+    void handle_message(const Message &message);
+
+    // false, and disconnected, if the other side's don't match ours
+    bool check_session_parameters(const SessionParameters &remote);
+
+    // joins the thread; the most derived destructor has to call this before any sockets go away
+    void stop();
+
+    boost::asio::io_context io_context_;
+    std::thread thread_;
+    SpscQueue<Message> read_queue_; // network thread to game thread
+    std::atomic<Status> status_ = Status::Connecting;
+    NetStats stats_;
+    SessionParameters session_parameters_;
+
+private:
+    void start_ping_timer();
+
+    boost::asio::steady_timer ping_timer_;
+};
+
+// One Message per write, in order, over a TCP stream. Each side starts with its SessionParameters.
+class TcpNetworkThread : public NetworkThread
+{
+protected:
+    TcpNetworkThread();
+
+    void send_message(const Message &message) override;
+
+    void handle_connected(boost::system::error_code ec);
+    void do_read_session_parameters();
+    void do_read();
+
+    boost::asio::ip::tcp::socket socket_;
+    SessionParameters remote_session_parameters_;
+    Message read_message_;
+};
+
+class TcpServerNetworkThread : public TcpNetworkThread
+{
+public:
+    TcpServerNetworkThread(int port);
+    ~TcpServerNetworkThread() override;
+
+private:
+    void do_connect() override;
+
+    boost::asio::ip::tcp::acceptor acceptor_;
+};
+
+class TcpClientNetworkThread : public TcpNetworkThread
+{
+public:
+    TcpClientNetworkThread(std::string_view host, std::string_view service);
+    ~TcpClientNetworkThread() override;
+
+private:
+    void do_connect() override;
+
+    boost::asio::ip::tcp::resolver::iterator endpoint_iterator_;
+};
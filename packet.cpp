@@ -0,0 +1,132 @@
+#include "packet.h"
+
+#include <cassert>
+
+namespace
+{
+constexpr auto MaxShortRun = 8;
+constexpr auto MaxRun = MaxShortRun + 255;
+}
+
+void PacketWriter::put_u8(uint8_t value)
+{
+    data_.push_back(value);
+}
+
+void PacketWriter::put_u16(uint16_t value)
+{
+    put_u8(value & 0xff);
+    put_u8(value >> 8);
+}
+
+void PacketWriter::put_u32(uint32_t value)
+{
+    put_u16(value & 0xffff);
+    put_u16(value >> 16);
+}
+
+void PacketWriter::put_bytes(const std::vector<uint8_t> &bytes)
+{
+    data_.insert(data_.end(), bytes.begin(), bytes.end());
+}
+
+void PacketWriter::put_inputs(uint32_t first_tic, const std::vector<uint8_t> &inputs)
+{
+    assert(inputs.size() <= 0xffff);
+
+    put_u32(first_tic);
+    put_u16(inputs.size());
+
+    for (std::size_t i = 0; i < inputs.size();)
+    {
+        const auto state = inputs[i];
+        assert(state < 32);
+
+        std::size_t run = 1;
+        while (i + run < inputs.size() && inputs[i + run] == state && run < MaxRun)
+            ++run;
+
+        if (run < MaxShortRun)
+        {
+            put_u8((state << 3) | (run - 1));
+        }
+        else
+        {
+            put_u8((state << 3) | (MaxShortRun - 1));
+            put_u8(run - MaxShortRun);
+        }
+
+        i += run;
+    }
+}
+
+PacketReader::PacketReader(const uint8_t *data, std::size_t size)
+    : cur_(data)
+    , end_(data + size)
+{
+}
+
+bool PacketReader::get_u8(uint8_t &value)
+{
+    if (cur_ == end_)
+        return false;
+    value = *cur_++;
+    return true;
+}
+
+bool PacketReader::get_u16(uint16_t &value)
+{
+    uint8_t lo, hi;
+    if (!get_u8(lo) || !get_u8(hi))
+        return false;
+    value = lo | (hi << 8);
+    return true;
+}
+
+bool PacketReader::get_u32(uint32_t &value)
+{
+    uint16_t lo, hi;
+    if (!get_u16(lo) || !get_u16(hi))
+        return false;
+    value = lo | (static_cast<uint32_t>(hi) << 16);
+    return true;
+}
+
+bool PacketReader::get_bytes(std::size_t size, const uint8_t *&bytes)
+{
+    if (static_cast<std::size_t>(end_ - cur_) < size)
+        return false;
+    bytes = cur_;
+    cur_ += size;
+    return true;
+}
+
+bool PacketReader::get_inputs(uint32_t &first_tic, std::vector<uint8_t> &inputs)
+{
+    uint16_t count;
+    if (!get_u32(first_tic) || !get_u16(count))
+        return false;
+
+    inputs.clear();
+    while (inputs.size() < count)
+    {
+        uint8_t code;
+        if (!get_u8(code))
+            return false;
+
+        std::size_t run = (code & 7) + 1;
+        if (run == MaxShortRun)
+        {
+            uint8_t extra;
+            if (!get_u8(extra))
+                return false;
+            run += extra;
+        }
+
+        if (inputs.size() + run > count)
+            return false;
+        inputs.insert(inputs.end(), run, code >> 3);
+    }
+
+    return true;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Little endian byte (de)serialization for datagrams.
+
+class PacketWriter
+{
+public:
+    void put_u8(uint8_t value);
+    void put_u16(uint16_t value);
+    void put_u32(uint32_t value);
+    void put_bytes(const std::vector<uint8_t> &bytes);
+
+    // Runs of the same dpad state starting at first_tic. A run is one byte, state in the top 5 bits and
+    // length - 1 in the bottom 3; length 8 means another byte follows with the rest of the run.
+    void put_inputs(uint32_t first_tic, const std::vector<uint8_t> &inputs);
+
+    const std::vector<uint8_t> &data() const { return data_; }
+    void clear() { data_.clear(); }
+
+private:
+    std::vector<uint8_t> data_;
+};
+
+class PacketReader
+{
+public:
+    PacketReader(const uint8_t *data, std::size_t size);
+
+    // all of these return false past the end of the packet, which then counts as malformed
+    bool get_u8(uint8_t &value);
+    bool get_u16(uint16_t &value);
+    bool get_u32(uint32_t &value);
+    bool get_bytes(std::size_t size, const uint8_t *&bytes); // points into the packet
+    bool get_inputs(uint32_t &first_tic, std::vector<uint8_t> &inputs);
+
+    bool at_end() const { return cur_ == end_; }
+
+private:
+    const uint8_t *cur_;
+    const uint8_t *end_;
+};
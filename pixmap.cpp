@@ -5,6 +5,7 @@
 #include <boost/noncopyable.hpp>
 
 #include <algorithm>
+#include <string>
 #include <png.h>
 
 namespace
@@ -49,10 +50,29 @@ Pixmap::PixelType to_pixel_type(png_byte png_color_type)
     }
 }
 
+png_byte to_png_color_type(Pixmap::PixelType type)
+{
+    switch (type)
+    {
+    case Pixmap::PixelType::Gray:
+    default:
+        return PNG_COLOR_TYPE_GRAY;
+
+    case Pixmap::PixelType::GrayAlpha:
+        return PNG_COLOR_TYPE_GRAY_ALPHA;
+
+    case Pixmap::PixelType::RGB:
+        return PNG_COLOR_TYPE_RGB;
+
+    case Pixmap::PixelType::RGBAlpha:
+        return PNG_COLOR_TYPE_RGBA;
+    }
+}
+
 class File : private boost::noncopyable
 {
 public:
-    File(const std::string &path) : fp_(fopen(path.c_str(), "rb")) { }
+    File(const std::string &path, const char *mode = "rb") : fp_(fopen(path.c_str(), mode)) { }
     ~File() { fclose(fp_); }
 
     operator FILE *() const { return fp_; }
@@ -126,3 +146,35 @@ std::unique_ptr<Pixmap> load_pixmap_from_png(const char *path)
 
     return pm;
 }
+
+void save_pixmap_to_png(const Pixmap &pm, const char *path)
+{
+    File file(path, "wb");
+    if (!file)
+        panic("failed to open %s\n", path);
+
+    png_structp png_ptr;
+    if (!(png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, 0, 0, 0)))
+        panic("png_create_write_struct\n");
+
+    png_infop info_ptr;
+    if (!(info_ptr = png_create_info_struct(png_ptr)))
+        panic("png_create_info_struct\n");
+
+    if (setjmp(png_jmpbuf(png_ptr)))
+        panic("png error?\n");
+
+    png_init_io(png_ptr, file);
+
+    png_set_IHDR(png_ptr, info_ptr, pm.width, pm.height, 8, to_png_color_type(pm.type), PNG_INTERLACE_NONE,
+                 PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+
+    std::vector<png_bytep> rows(pm.height);
+    for (size_t i = 0; i < pm.height; i++)
+        rows[i] = const_cast<png_bytep>(pm.pixels.data() + i * pm.row_stride());
+    png_set_rows(png_ptr, info_ptr, rows.data());
+
+    png_write_png(png_ptr, info_ptr, PNG_TRANSFORM_IDENTITY, 0);
+
+    png_destroy_write_struct(&png_ptr, &info_ptr);
+}
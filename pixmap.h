@@ -26,3 +26,4 @@ struct Pixmap
 };
 
 std::unique_ptr<Pixmap> load_pixmap_from_png(const char *path);
+void save_pixmap_to_png(const Pixmap &pm, const char *path);
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cassert>
+#include <condition_variable>
+#include <mutex>
+#include <queue>
+
+template <typename T>
+class Queue
+{
+public:
+    void push(const T &value)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            data_.push(value);
+        }
+        not_empty_.notify_one();
+    }
+
+    T pop()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        not_empty_.wait(lock, [this]() {
+            return !data_.empty();
+        });
+
+        assert(!data_.empty());
+        const auto result = data_.front();
+        data_.pop();
+
+        return result;
+    }
+
+    bool try_pop(T &value)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (data_.empty())
+            return false;
+
+        value = data_.front();
+        data_.pop();
+
+        return true;
+    }
+
+private:
+    std::mutex mutex_;
+    std::queue<T> data_;
+    std::condition_variable not_empty_;
+};
@@ -0,0 +1,249 @@
+#include "queue.h"
+#include "spscqueue.h"
+#include "network.h"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+
+#include <unistd.h>
+
+// Network thread to game thread handoff: the mutex/condition variable Queue against the lock-free SpscQueue,
+// passing Messages like the network thread does. Polling loops yield when they come up empty, so numbers
+// stay meaningful on machines with fewer cores than threads.
+
+namespace
+{
+using Clock = std::chrono::steady_clock;
+
+constexpr auto SpscCapacity = 1024;
+
+template<typename F>
+double seconds(F &&f)
+{
+    const auto start = Clock::now();
+    f();
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+void report(const char *label, int count, double elapsed)
+{
+    std::cout << label << ": " << count / elapsed * 1e-6 << " M messages/s, " << elapsed * 1e9 / count
+              << " ns/message\n";
+}
+
+Message make_message(int i)
+{
+    return {Message::Type::Input, static_cast<uint32_t>(i), static_cast<uint32_t>(i & 31)};
+}
+
+// one thread pushes count messages, the calling thread receives them with receive(count)
+template<typename Q, typename Push, typename Receive>
+double throughput(Q &queue, int count, Push push, Receive receive)
+{
+    return seconds([&] {
+        std::thread producer([&] {
+            for (int i = 0; i < count; ++i)
+                push(queue, make_message(i));
+        });
+        receive(queue, count);
+        producer.join();
+    });
+}
+
+void check(const Message &message, uint32_t expected)
+{
+    if (message.tic != expected)
+    {
+        std::cerr << "out of order: got " << message.tic << ", expected " << expected << '\n';
+        std::exit(1);
+    }
+}
+
+void throughput_benchmarks(int count)
+{
+    {
+        Queue<Message> queue;
+        report("Queue, pop", count,
+               throughput(
+                   queue, count, [](auto &q, const Message &m) { q.push(m); },
+                   [](auto &q, int count) {
+                       for (int i = 0; i < count; ++i)
+                           check(q.pop(), i);
+                   }));
+    }
+
+    {
+        Queue<Message> queue;
+        report("Queue, try_pop polling", count,
+               throughput(
+                   queue, count, [](auto &q, const Message &m) { q.push(m); },
+                   [](auto &q, int count) {
+                       Message m;
+                       for (int i = 0; i < count;)
+                       {
+                           if (q.try_pop(m))
+                               check(m, i++);
+                           else
+                               std::this_thread::yield();
+                       }
+                   }));
+    }
+
+    {
+        SpscQueue<Message> queue(SpscCapacity);
+        report("SpscQueue, try_pop polling", count,
+               throughput(
+                   queue, count, [](auto &q, const Message &m) { q.push(m); },
+                   [](auto &q, int count) {
+                       Message m;
+                       for (int i = 0; i < count;)
+                       {
+                           if (q.try_pop(m))
+                               check(m, i++);
+                           else
+                               std::this_thread::yield();
+                       }
+                   }));
+    }
+
+    {
+        SpscQueue<Message> queue(SpscCapacity);
+        report("SpscQueue, drain polling", count,
+               throughput(
+                   queue, count, [](auto &q, const Message &m) { q.push(m); },
+                   [](auto &q, int count) {
+                       int i = 0;
+                       while (i < count)
+                       {
+                           if (!q.drain([&i](const Message &m) { check(m, i++); }))
+                               std::this_thread::yield();
+                       }
+                   }));
+    }
+
+    {
+        SpscQueue<Message> queue(SpscCapacity);
+        report("SpscQueue, wait + drain", count,
+               throughput(
+                   queue, count, [](auto &q, const Message &m) { q.push(m); },
+                   [](auto &q, int count) {
+                       int i = 0;
+                       while (i < count)
+                       {
+                           q.wait();
+                           q.drain([&i](const Message &m) { check(m, i++); });
+                       }
+                   }));
+    }
+}
+
+// what the game thread pays every tic when nothing came in
+void empty_poll_benchmarks(int count)
+{
+    Message m;
+    int hits = 0;
+
+    {
+        Queue<Message> queue;
+        const auto elapsed = seconds([&] {
+            for (int i = 0; i < count; ++i)
+                hits += queue.try_pop(m);
+        });
+        std::cout << "Queue, empty try_pop: " << elapsed * 1e9 / count << " ns\n";
+    }
+
+    {
+        SpscQueue<Message> queue(SpscCapacity);
+        const auto elapsed = seconds([&] {
+            for (int i = 0; i < count; ++i)
+                hits += queue.try_pop(m);
+        });
+        std::cout << "SpscQueue, empty try_pop: " << elapsed * 1e9 / count << " ns\n";
+    }
+
+    if (hits) // keeps the loops from being optimized away
+        std::cout << "unexpected message\n";
+}
+
+// one message there, one back: how long a single message takes to get across, including waking up
+template<typename Q, typename Receive>
+void round_trip(const char *label, int count, Receive receive)
+{
+    Q ping(SpscCapacity), pong(SpscCapacity);
+
+    const auto elapsed = seconds([&] {
+        std::thread echo([&] {
+            for (int i = 0; i < count; ++i)
+                pong.push(receive(ping));
+        });
+        for (int i = 0; i < count; ++i)
+        {
+            ping.push(make_message(i));
+            check(receive(pong), i);
+        }
+        echo.join();
+    });
+
+    std::cout << label << ": " << elapsed * 1e9 / count << " ns\n";
+}
+
+// Queue has no capacity
+template<typename T>
+class BoundedQueue : public Queue<T>
+{
+public:
+    explicit BoundedQueue(std::size_t) {}
+};
+
+void round_trip_benchmarks(int count)
+{
+    round_trip<BoundedQueue<Message>>("Queue, pop round trip", count, [](auto &q) { return q.pop(); });
+    round_trip<SpscQueue<Message>>("SpscQueue, try_pop polling round trip", count, [](auto &q) {
+        Message m;
+        while (!q.try_pop(m))
+            std::this_thread::yield();
+        return m;
+    });
+    round_trip<SpscQueue<Message>>("SpscQueue, wait round trip", count, [](auto &q) {
+        Message m;
+        while (!q.try_pop(m))
+            q.wait();
+        return m;
+    });
+}
+}
+
+static void usage(const char *argv0)
+{
+    std::cerr << "usage: " << argv0 << " [-n messages]\n";
+    std::exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+    int count = 10000000;
+
+    int c;
+    while ((c = getopt(argc, argv, "n:")) != EOF)
+    {
+        switch (c)
+        {
+            case 'n':
+                count = std::atoi(optarg);
+                break;
+
+            default:
+                usage(argv[0]);
+        }
+    }
+
+    if (count <= 0)
+        usage(argv[0]);
+
+    throughput_benchmarks(count);
+    empty_poll_benchmarks(count);
+    round_trip_benchmarks(count / 10);
+}
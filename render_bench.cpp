@@ -0,0 +1,301 @@
+#include "panic.h"
+
+#include "spritebatcher.h"
+#include "rendertarget.h"
+#include "tilesheet.h"
+#include "trajectory.h"
+#include "level.h"
+#include "world.h"
+#include "background.h"
+#include "foeclass.h"
+#include "pixmap.h"
+#include "dpadstate.h"
+#include "gameconstants.h"
+
+#include <GL/glew.h>
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <numeric>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+// Renders a World without a window: drives it through a session recorded with `demo -r` (or a canned one),
+// timing the CPU side of each frame and the GPU side with timer queries, and optionally dumping frames.
+
+// same as the game
+static constexpr const auto NativeScale = 2;
+
+namespace
+{
+class HeadlessContext
+{
+public:
+    HeadlessContext()
+    {
+        // prefer the surfaceless platform so no display server is needed at all
+        const auto get_platform_display =
+            reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(eglGetProcAddress("eglGetPlatformDisplayEXT"));
+        display_ = get_platform_display ? get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr)
+                                        : EGL_NO_DISPLAY;
+        if (display_ == EGL_NO_DISPLAY)
+            display_ = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+        if (display_ == EGL_NO_DISPLAY || !eglInitialize(display_, nullptr, nullptr))
+            panic("failed to initialize EGL\n");
+
+        if (!eglBindAPI(EGL_OPENGL_API))
+            panic("eglBindAPI failed\n");
+
+        static const EGLint config_attribs[] = {
+            EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+            EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+            EGL_NONE
+        };
+        EGLConfig config;
+        EGLint config_count;
+        if (!eglChooseConfig(display_, config_attribs, &config, 1, &config_count) || config_count == 0)
+            panic("eglChooseConfig failed\n");
+
+        static const EGLint context_attribs[] = {
+            EGL_CONTEXT_MAJOR_VERSION, 4,
+            EGL_CONTEXT_MINOR_VERSION, 5,
+            EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+            EGL_NONE
+        };
+        context_ = eglCreateContext(display_, config, EGL_NO_CONTEXT, context_attribs);
+        if (context_ == EGL_NO_CONTEXT)
+            panic("eglCreateContext failed\n");
+
+        // everything is drawn into a RenderTarget, so no surface is needed (EGL_KHR_surfaceless_context)
+        if (!eglMakeCurrent(display_, EGL_NO_SURFACE, EGL_NO_SURFACE, context_))
+            panic("eglMakeCurrent failed\n");
+
+        // with GLX builds of GLEW there's no GLX display here, but the GL entry points still get loaded
+        glewExperimental = GL_TRUE;
+        const auto result = glewInit();
+        if (result != GLEW_OK && result != GLEW_ERROR_NO_GLX_DISPLAY)
+            panic("glewInit failed: %s\n", glewGetErrorString(result));
+
+        std::cout << "renderer: " << glGetString(GL_RENDERER) << '\n';
+    }
+
+    ~HeadlessContext()
+    {
+        eglMakeCurrent(display_, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        eglDestroyContext(display_, context_);
+        eglTerminate(display_);
+    }
+
+private:
+    EGLDisplay display_;
+    EGLContext context_;
+};
+
+std::vector<unsigned> load_session(const char *path)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+        panic("failed to open %s\n", path);
+    std::vector<unsigned> session;
+    std::transform(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>(), std::back_inserter(session),
+                   [](char c) { return static_cast<unsigned char>(c); });
+    return session;
+}
+
+// sweep left and right while firing, so there's something going on without a recording
+std::vector<unsigned> canned_session(int tics)
+{
+    std::vector<unsigned> session(tics);
+    for (int i = 0; i < tics; ++i)
+        session[i] = DPad_Button | ((i / 90) % 2 ? DPad_Left : DPad_Right);
+    return session;
+}
+
+std::unique_ptr<Pixmap> read_pixels(const RenderTarget &target)
+{
+    const auto width = target.width();
+    const auto height = target.height();
+
+    std::vector<uint8_t> pixels(width * height * 4);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+
+    // GL rows are bottom-up
+    auto pm = std::make_unique<Pixmap>(width, height, Pixmap::PixelType::RGBAlpha);
+    const auto stride = pm->row_stride();
+    for (int i = 0; i < height; ++i)
+    {
+        const auto *src = pixels.data() + (height - 1 - i) * stride;
+        std::copy(src, src + stride, pm->pixels.data() + i * stride);
+    }
+    return pm;
+}
+
+void print_stats(const char *label, std::vector<float> samples)
+{
+    if (samples.empty())
+        return;
+    std::sort(samples.begin(), samples.end());
+    const auto percentile = [&samples](float p) {
+        return samples[std::min(samples.size() - 1, static_cast<size_t>(p * samples.size()))];
+    };
+    const auto mean = std::accumulate(samples.begin(), samples.end(), 0.0f) / samples.size();
+    std::cout << label << ": mean " << mean << " ms, p50 " << percentile(0.5f) << " ms, p95 " << percentile(0.95f)
+              << " ms, max " << samples.back() << " ms\n";
+}
+}
+
+static void usage(const char *argv0)
+{
+    std::cerr << "usage: " << argv0 << " [-s session] [-n frames] [-o dump_dir] [-e dump_every] [-c stats.csv]\n";
+    std::exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *session_path = nullptr;
+    const char *dump_dir = nullptr;
+    const char *stats_path = nullptr;
+    int frames = 0;
+    int dump_every = 1;
+
+    int c;
+    while ((c = getopt(argc, argv, "s:n:o:e:c:")) != EOF)
+    {
+        switch (c)
+        {
+            case 's':
+                session_path = optarg;
+                break;
+
+            case 'n':
+                frames = std::atoi(optarg);
+                break;
+
+            case 'o':
+                dump_dir = optarg;
+                break;
+
+            case 'e':
+                dump_every = std::max(1, std::atoi(optarg));
+                break;
+
+            case 'c':
+                stats_path = optarg;
+                break;
+
+            default:
+                usage(argv[0]);
+        }
+    }
+
+    const auto session = session_path ? load_session(session_path) : canned_session(frames > 0 ? frames : 3600);
+    if (frames <= 0 || frames > session.size())
+        frames = session.size();
+
+    HeadlessContext context;
+
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+    cache_tilesheet("resources/tilesheets/sheet.json");
+    cache_tilesheet("resources/tilesheets/background.json");
+    initialize_foe_classes();
+    auto sprite_batcher = std::make_unique<SpriteBatcher>();
+
+    {
+        auto level = load_level("resources/levels/level-0.json");
+        World world(ViewportWidth, ViewportHeight);
+        world.initialize_level(level.get());
+        Background background(level.get(), ViewportHeight);
+
+        RenderTarget target(ViewportWidth / NativeScale, ViewportHeight / NativeScale);
+
+        const auto transform =
+            glm::ortho(0.0f, static_cast<float>(ViewportWidth), static_cast<float>(ViewportHeight), 0.0f);
+
+        // timestamps rather than GL_TIME_ELAPSED, which the sprite batcher is already using and can't be nested
+        std::vector<GLuint> queries(2 * frames);
+        glGenQueries(queries.size(), queries.data());
+
+        std::ofstream stats_file;
+        if (stats_path)
+        {
+            stats_file.open(stats_path);
+            if (!stats_file)
+                panic("failed to open %s\n", stats_path);
+            RenderStats::write_csv_header(stats_file, 1);
+        }
+
+        RenderList list;
+
+        std::vector<float> cpu_times;
+        cpu_times.reserve(frames);
+
+        for (int frame = 0; frame < frames; ++frame)
+        {
+            world.advance(session[frame]);
+
+            list.clear();
+            world.render(list);
+
+            glQueryCounter(queries[2 * frame], GL_TIMESTAMP);
+            const auto start = std::chrono::steady_clock::now();
+
+            target.bind();
+            glClearColor(0, 0, 0, 0);
+            glClear(GL_COLOR_BUFFER_BIT);
+
+            sprite_batcher->start_batch();
+            sprite_batcher->set_viewport(0, transform, glm::vec4(0, 0, ViewportWidth, ViewportHeight));
+            sprite_batcher->set_current_viewport(0);
+            background.render(transform, list.tic);
+            list.add_to_batch(*sprite_batcher, 1.0f);
+            sprite_batcher->render_batch();
+
+            const auto end = std::chrono::steady_clock::now();
+            glQueryCounter(queries[2 * frame + 1], GL_TIMESTAMP);
+
+            cpu_times.push_back(std::chrono::duration<float, std::milli>(end - start).count());
+
+            if (stats_file.is_open())
+                sprite_batcher->stats().write_csv(stats_file);
+
+            // reading back stalls the pipeline, so timings of dumped frames include that
+            if (dump_dir && frame % dump_every == 0)
+            {
+                const auto path = std::string(dump_dir) + "/frame-" + std::to_string(frame) + ".png";
+                save_pixmap_to_png(*read_pixels(target), path.c_str());
+            }
+        }
+
+        std::vector<float> gpu_times;
+        gpu_times.reserve(frames);
+        for (int frame = 0; frame < frames; ++frame)
+        {
+            GLuint64 start, end;
+            glGetQueryObjectui64v(queries[2 * frame], GL_QUERY_RESULT, &start);
+            glGetQueryObjectui64v(queries[2 * frame + 1], GL_QUERY_RESULT, &end);
+            gpu_times.push_back((end - start) * 1e-6f);
+        }
+        glDeleteQueries(queries.size(), queries.data());
+
+        std::cout << frames << " frames\n";
+        print_stats("cpu submit", cpu_times);
+        print_stats("gpu", gpu_times);
+    }
+
+    sprite_batcher.reset();
+    release_tilesheets();
+}
@@ -0,0 +1,27 @@
+#include "renderlist.h"
+
+#ifndef HEADLESS
+#include "spritebatcher.h"
+#endif
+
+#include <glm/glm.hpp>
+
+void RenderList::clear()
+{
+    // keeps the capacity, lists are reused every tic
+    tic = 0;
+    collision = false;
+    sprites.clear();
+    trajectories.clear();
+}
+
+#ifndef HEADLESS
+void RenderList::add_to_batch(SpriteBatcher &batcher, float alpha) const
+{
+    for (const auto &sprite : sprites)
+    {
+        const auto position = glm::mix(sprite.prev_position, sprite.position, alpha);
+        batcher.add_sprite(sprite.tile, position, glm::vec2(SpriteScale), 0.0f, sprite.flat_color, sprite.depth);
+    }
+}
+#endif
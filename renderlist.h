@@ -0,0 +1,38 @@
+#pragma once
+
+#include <glm/vec2.hpp>
+#include <glm/vec4.hpp>
+
+#include <vector>
+
+// #define DRAW_ACTIVE_TRAJECTORIES
+
+struct Tile;
+class Trajectory;
+class SpriteBatcher;
+
+static constexpr const auto SpriteScale = 2.0f;
+
+struct RenderSprite
+{
+    const Tile *tile;
+    glm::vec2 position;
+    glm::vec2 prev_position; // at the previous tic
+    glm::vec4 flat_color; // mixed in by flat_color.a
+    int depth;
+};
+
+// Everything needed to draw a World, without touching GL, so it can be filled in by the simulation thread.
+struct RenderList
+{
+    int tic = 0;
+    bool collision = false; // only with DRAW_COLLISIONS
+    std::vector<RenderSprite> sprites;
+    std::vector<const Trajectory *> trajectories; // only with DRAW_ACTIVE_TRAJECTORIES
+
+    void clear();
+#ifndef HEADLESS
+    // alpha is how far we are between the previous tic and this one
+    void add_to_batch(SpriteBatcher &batcher, float alpha) const;
+#endif
+};
@@ -0,0 +1,168 @@
+#include "renderstate.h"
+
+#include "panic.h"
+
+#include <algorithm>
+#include <array>
+#include <vector>
+
+namespace
+{
+constexpr std::array<GLenum, 2> TextureTargets = {GL_TEXTURE_2D, GL_TEXTURE_2D_ARRAY};
+constexpr std::array<GLenum, 3> BufferTargets = {GL_ARRAY_BUFFER, GL_SHADER_STORAGE_BUFFER, GL_UNIFORM_BUFFER};
+
+template<std::size_t Size>
+std::size_t target_index(const std::array<GLenum, Size> &targets, GLenum target)
+{
+    const auto it = std::find(targets.begin(), targets.end(), target);
+    if (it == targets.end())
+        panic("untracked binding target %x\n", target);
+    return std::distance(targets.begin(), it);
+}
+
+struct IndexedBinding
+{
+    GLenum target;
+    GLuint index;
+    GLuint buffer;
+    GLintptr offset;
+    GLsizeiptr size; // 0 for the whole buffer
+};
+
+struct RenderState
+{
+    GLuint program = 0;
+    std::array<GLuint, TextureTargets.size()> textures = {};
+    GLuint vertex_array = 0;
+    std::array<GLuint, BufferTargets.size()> buffers = {};
+    std::vector<IndexedBinding> indexed_buffers;
+    RenderStateCounters counters;
+
+    // returns true if the bind has to be issued
+    bool update(GLuint &cur, GLuint value);
+    bool update_indexed(const IndexedBinding &binding);
+};
+
+RenderState &get_render_state()
+{
+    static RenderState state;
+    return state;
+}
+
+bool RenderState::update(GLuint &cur, GLuint value)
+{
+    if (cur == value)
+    {
+        ++counters.skipped;
+        return false;
+    }
+    cur = value;
+    ++counters.issued;
+    return true;
+}
+
+bool RenderState::update_indexed(const IndexedBinding &binding)
+{
+    // glBindBufferBase/Range also bind the buffer to the generic binding point
+    buffers[target_index(BufferTargets, binding.target)] = binding.buffer;
+
+    auto it = std::find_if(indexed_buffers.begin(), indexed_buffers.end(), [&binding](const IndexedBinding &cur) {
+        return cur.target == binding.target && cur.index == binding.index;
+    });
+    if (it == indexed_buffers.end())
+    {
+        indexed_buffers.push_back(binding);
+    }
+    else
+    {
+        if (it->buffer == binding.buffer && it->offset == binding.offset && it->size == binding.size)
+        {
+            ++counters.skipped;
+            return false;
+        }
+        *it = binding;
+    }
+    ++counters.issued;
+    return true;
+}
+}
+
+void bind_program(GLuint program)
+{
+    if (get_render_state().update(get_render_state().program, program))
+        glUseProgram(program);
+}
+
+void bind_texture(GLenum target, GLuint texture)
+{
+    auto &state = get_render_state();
+    if (state.update(state.textures[target_index(TextureTargets, target)], texture))
+        glBindTexture(target, texture);
+}
+
+void bind_vertex_array(GLuint vertex_array)
+{
+    auto &state = get_render_state();
+    if (state.update(state.vertex_array, vertex_array))
+        glBindVertexArray(vertex_array);
+}
+
+void bind_buffer(GLenum target, GLuint buffer)
+{
+    auto &state = get_render_state();
+    if (state.update(state.buffers[target_index(BufferTargets, target)], buffer))
+        glBindBuffer(target, buffer);
+}
+
+void bind_buffer_base(GLenum target, GLuint index, GLuint buffer)
+{
+    if (get_render_state().update_indexed({target, index, buffer, 0, 0}))
+        glBindBufferBase(target, index, buffer);
+}
+
+void bind_buffer_range(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size)
+{
+    if (get_render_state().update_indexed({target, index, buffer, offset, size}))
+        glBindBufferRange(target, index, buffer, offset, size);
+}
+
+void program_deleted(GLuint program)
+{
+    auto &state = get_render_state();
+    if (state.program == program)
+        state.program = 0;
+}
+
+void texture_deleted(GLuint texture)
+{
+    auto &textures = get_render_state().textures;
+    std::replace(textures.begin(), textures.end(), texture, 0u);
+}
+
+void vertex_array_deleted(GLuint vertex_array)
+{
+    auto &state = get_render_state();
+    if (state.vertex_array == vertex_array)
+        state.vertex_array = 0;
+}
+
+void buffer_deleted(GLuint buffer)
+{
+    auto &state = get_render_state();
+    std::replace(state.buffers.begin(), state.buffers.end(), buffer, 0u);
+
+    auto &indexed = state.indexed_buffers;
+    indexed.erase(std::remove_if(indexed.begin(), indexed.end(), [buffer](const IndexedBinding &binding) {
+        return binding.buffer == buffer;
+    }), indexed.end());
+}
+
+const RenderStateCounters &render_state_counters()
+{
+    return get_render_state().counters;
+}
+
+void reset_render_state_counters()
+{
+    get_render_state().counters = {};
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <GL/glew.h>
+
+// Cache of the current GL bindings, so that binding what's already bound costs nothing. Every program,
+// texture, vertex array and buffer bind has to go through here for the cache to stay in sync, and deleted
+// objects have to be reported since GL recycles their names.
+
+void bind_program(GLuint program);
+void bind_texture(GLenum target, GLuint texture); // on texture unit 0
+void bind_vertex_array(GLuint vertex_array);
+void bind_buffer(GLenum target, GLuint buffer);
+void bind_buffer_base(GLenum target, GLuint index, GLuint buffer);
+void bind_buffer_range(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size);
+
+void program_deleted(GLuint program);
+void texture_deleted(GLuint texture);
+void vertex_array_deleted(GLuint vertex_array);
+void buffer_deleted(GLuint buffer);
+
+struct RenderStateCounters
+{
+    int issued = 0;
+    int skipped = 0;
+};
+
+const RenderStateCounters &render_state_counters();
+void reset_render_state_counters();
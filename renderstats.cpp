@@ -0,0 +1,72 @@
+#include "renderstats.h"
+
+#include <ostream>
+
+void RenderStats::write_csv_header(std::ostream &os, int viewport_count)
+{
+    os << "frame,draw_calls,quads,bytes_uploaded,texture_switches,gpu_ms";
+    for (int i = 0; i < viewport_count; ++i)
+        os << ",viewport" << i << "_quads";
+    os << '\n';
+}
+
+void RenderStats::write_csv(std::ostream &os) const
+{
+    os << frame << ',' << draw_calls << ',' << quads << ',' << bytes_uploaded << ',' << texture_switches << ','
+       << gpu_milliseconds;
+    for (const auto count : viewport_quads)
+        os << ',' << count;
+    os << '\n';
+}
+
+GpuTimer::GpuTimer()
+{
+    glGenQueries(QueriesInFlight, queries_.data());
+}
+
+GpuTimer::~GpuTimer()
+{
+    glDeleteQueries(QueriesInFlight, queries_.data());
+}
+
+void GpuTimer::begin()
+{
+    collect(cur_query_);
+    timing_ = !pending_[cur_query_];
+    if (timing_)
+        glBeginQuery(GL_TIME_ELAPSED, queries_[cur_query_]);
+}
+
+void GpuTimer::end()
+{
+    if (!timing_)
+        return;
+    glEndQuery(GL_TIME_ELAPSED);
+    pending_[cur_query_] = true;
+    cur_query_ = (cur_query_ + 1) % QueriesInFlight;
+    timing_ = false;
+}
+
+float GpuTimer::milliseconds()
+{
+    // oldest first, so the newest available result wins
+    for (int i = 0; i < QueriesInFlight; ++i)
+        collect((cur_query_ + i) % QueriesInFlight);
+    return milliseconds_;
+}
+
+void GpuTimer::collect(int index)
+{
+    if (!pending_[index])
+        return;
+
+    GLint available = 0;
+    glGetQueryObjectiv(queries_[index], GL_QUERY_RESULT_AVAILABLE, &available);
+    if (!available)
+        return;
+
+    GLuint64 elapsed;
+    glGetQueryObjectui64v(queries_[index], GL_QUERY_RESULT, &elapsed);
+    milliseconds_ = elapsed * 1e-6f;
+    pending_[index] = false;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <GL/glew.h>
+
+#include <boost/noncopyable.hpp>
+
+#include <array>
+#include <cstddef>
+#include <iosfwd>
+#include <vector>
+
+// Counters for one rendered batch.
+struct RenderStats
+{
+    int frame = 0; // number of the batch
+    int draw_calls = 0;
+    int quads = 0;
+    std::size_t bytes_uploaded = 0;
+    int texture_switches = 0;
+    float gpu_milliseconds = -1.0f; // of the latest batch the GPU has finished, usually an earlier one; negative if none
+    std::vector<int> viewport_quads; // viewports share draw calls, so only quads are counted per viewport
+
+    static void write_csv_header(std::ostream &os, int viewport_count);
+    void write_csv(std::ostream &os) const;
+};
+
+// GL_TIME_ELAPSED queries around a piece of GPU work, in a ring: results are only read once they're available,
+// so asking for them never stalls. If the GPU is so far behind that every query is still pending, the pair is
+// left untimed rather than dropping a result.
+class GpuTimer : private boost::noncopyable
+{
+public:
+    GpuTimer();
+    ~GpuTimer();
+
+    void begin();
+    void end();
+
+    float milliseconds(); // of the most recent finished begin/end pair, negative if none
+
+private:
+    void collect(int index);
+
+    // more than the frames the driver queues ahead, and the sprite batcher's ChunksInFlight
+    static constexpr const int QueriesInFlight = 4;
+
+    std::array<GLuint, QueriesInFlight> queries_;
+    std::array<bool, QueriesInFlight> pending_ = {};
+    int cur_query_ = 0;
+    bool timing_ = false; // between a begin() that got a query and its end()
+    float milliseconds_ = -1.0f;
+};
@@ -0,0 +1,74 @@
+#include "rendertarget.h"
+
+#include "panic.h"
+#include "renderstate.h"
+
+namespace
+{
+void check_framebuffer()
+{
+    const auto status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    if (status != GL_FRAMEBUFFER_COMPLETE)
+        panic("framebuffer incomplete: %x\n", status);
+}
+}
+
+RenderTarget::RenderTarget(int width, int height, int samples)
+    : width_(width)
+    , height_(height)
+    , samples_(samples)
+{
+    glGenTextures(1, &texture_);
+    bind_texture(GL_TEXTURE_2D, texture_);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, width_, height_);
+
+    glGenFramebuffers(1, &framebuffer_);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer_);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture_, 0);
+    check_framebuffer();
+
+    if (samples_ > 0)
+    {
+        glGenRenderbuffers(1, &multisample_renderbuffer_);
+        glBindRenderbuffer(GL_RENDERBUFFER, multisample_renderbuffer_);
+        glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples_, GL_RGBA8, width_, height_);
+
+        glGenFramebuffers(1, &multisample_framebuffer_);
+        glBindFramebuffer(GL_FRAMEBUFFER, multisample_framebuffer_);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, multisample_renderbuffer_);
+        check_framebuffer();
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+RenderTarget::~RenderTarget()
+{
+    if (samples_ > 0)
+    {
+        glDeleteFramebuffers(1, &multisample_framebuffer_);
+        glDeleteRenderbuffers(1, &multisample_renderbuffer_);
+    }
+    glDeleteFramebuffers(1, &framebuffer_);
+    texture_deleted(texture_);
+    glDeleteTextures(1, &texture_);
+}
+
+void RenderTarget::bind() const
+{
+    glBindFramebuffer(GL_FRAMEBUFFER, samples_ > 0 ? multisample_framebuffer_ : framebuffer_);
+    glViewport(0, 0, width_, height_);
+}
+
+void RenderTarget::resolve() const
+{
+    if (samples_ == 0)
+        return;
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, multisample_framebuffer_);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, framebuffer_);
+    glBlitFramebuffer(0, 0, width_, height_, 0, 0, width_, height_, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <GL/glew.h>
+
+#include <boost/noncopyable.hpp>
+
+// Offscreen color buffer that can be sampled after rendering. With samples > 0 rendering goes to a
+// multisampled renderbuffer that resolve() blits into the texture.
+class RenderTarget : private boost::noncopyable
+{
+public:
+    RenderTarget(int width, int height, int samples = 0);
+    ~RenderTarget();
+
+    void bind() const; // also sets the viewport
+    void resolve() const;
+
+    GLuint texture() const { return texture_; }
+    int width() const { return width_; }
+    int height() const { return height_; }
+
+private:
+    int width_;
+    int height_;
+    int samples_;
+    GLuint texture_ = 0;
+    GLuint framebuffer_ = 0;
+    GLuint multisample_renderbuffer_ = 0;
+    GLuint multisample_framebuffer_ = 0;
+};
@@ -0,0 +1,12 @@
+#version 450 core
+
+layout(binding=0) uniform sampler2DArray tile_texture;
+
+in vec3 tex_coord;
+
+out vec4 frag_color;
+
+void main(void)
+{
+    frag_color = texture(tile_texture, tex_coord);
+}
@@ -0,0 +1,16 @@
+#version 450 core
+
+layout(location=0) in vec2 position;
+layout(location=1) in vec2 texcoord;
+layout(location=2) in uint layer;
+
+uniform mat4 mvp;
+uniform vec2 offset;
+
+out vec3 tex_coord;
+
+void main(void)
+{
+    tex_coord = vec3(texcoord, layer);
+    gl_Position = mvp * vec4(position + offset, 0.0, 1.0);
+}
@@ -1,8 +1,8 @@
 #version 450 core
 
-uniform sampler2D sprite_texture;
+layout(binding=0) uniform sampler2DArray sprite_texture;
 
-in vec2 tex_coord;
+in vec3 tex_coord;
 in vec4 flat_color;
 
 out vec4 frag_color;
@@ -1,17 +1,57 @@
 #version 450 core
 
-layout(location=0) in vec2 position;
-layout(location=1) in vec2 vert_tex_coord;
-layout(location=2) in vec4 vert_flat_color;
+layout(location=0) in vec2 corner;
 
-uniform mat4 mvp;
+layout(location=1) in vec2 position;
+layout(location=2) in vec2 half_size;
+layout(location=3) in vec2 axis; // cos and sin of the rotation
+layout(location=4) in uint tile_and_viewport; // viewport index in the top 8 bits
+layout(location=5) in vec4 vert_flat_color;
 
-out vec2 tex_coord;
+struct TileInfo
+{
+    vec4 rect; // xy: texture coordinates of the top left corner, zw: size in texture coordinates
+    uint layer;
+};
+
+layout(std430, binding=0) readonly buffer TileTable
+{
+    TileInfo tiles[];
+};
+
+struct Viewport
+{
+    mat4 transform;
+    vec4 clip_rect; // x0, y0, x1, y1, before transform
+};
+
+const int MaxViewports = 8;
+
+layout(std140, binding=0) uniform Viewports
+{
+    Viewport viewports[MaxViewports];
+};
+
+out float gl_ClipDistance[4];
+
+out vec3 tex_coord;
 out vec4 flat_color;
 
 void main(void)
 {
-    tex_coord = vert_tex_coord;
+    uint tile_index = tile_and_viewport & 0xffffffu;
+    uint viewport_index = tile_and_viewport >> 24;
+
+    TileInfo tile = tiles[tile_index];
+    tex_coord = vec3(tile.rect.xy + (0.5 * corner + 0.5) * tile.rect.zw, float(tile.layer));
     flat_color = vert_flat_color;
-    gl_Position = mvp * vec4(position, 0.0, 1.0);
+
+    vec2 vertex = position + mat2(axis.x, axis.y, -axis.y, axis.x) * (corner * half_size);
+
+    Viewport viewport = viewports[viewport_index];
+    gl_ClipDistance[0] = vertex.x - viewport.clip_rect.x;
+    gl_ClipDistance[1] = vertex.y - viewport.clip_rect.y;
+    gl_ClipDistance[2] = viewport.clip_rect.z - vertex.x;
+    gl_ClipDistance[3] = viewport.clip_rect.w - vertex.y;
+    gl_Position = viewport.transform * vec4(vertex, 0.0, 1.0);
 }
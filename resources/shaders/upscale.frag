@@ -0,0 +1,12 @@
+#version 450 core
+
+layout(binding=0) uniform sampler2D native_texture;
+
+in vec2 tex_coord;
+
+out vec4 frag_color;
+
+void main(void)
+{
+    frag_color = vec4(texture(native_texture, tex_coord).rgb, 1.0);
+}
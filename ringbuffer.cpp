@@ -0,0 +1,79 @@
+#include "ringbuffer.h"
+
+#include "panic.h"
+#include "renderstate.h"
+
+#include <algorithm>
+#include <cassert>
+
+RingBuffer::RingBuffer(GLenum target, std::size_t size)
+    : target_(target)
+    , size_(size)
+{
+    constexpr GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+    glGenBuffers(1, &id_);
+    bind_buffer(target_, id_);
+    glBufferStorage(target_, size_, nullptr, flags);
+    data_ = reinterpret_cast<char *>(glMapBufferRange(target_, 0, size_, flags));
+
+    if (!data_)
+        panic("failed to map ring buffer\n");
+}
+
+RingBuffer::~RingBuffer()
+{
+    for (const auto &fence : fences_)
+        glDeleteSync(fence.sync);
+    buffer_deleted(id_);
+    glDeleteBuffers(1, &id_); // implicitly unmaps
+}
+
+RingBuffer::Range RingBuffer::allocate(std::size_t size, std::size_t alignment)
+{
+    assert(size <= size_);
+
+    auto offset = (head_ + alignment - 1) / alignment * alignment;
+    if (offset + size > size_)
+        offset = 0;
+
+    Range range{offset, size, data_ + offset};
+    wait_for(range);
+
+    head_ = offset + size;
+    return range;
+}
+
+void RingBuffer::lock(const Range &range)
+{
+    const auto sync = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    fences_.push_back({sync, range.offset, range.offset + range.size});
+}
+
+void RingBuffer::wait_for(const Range &range)
+{
+    // fences complete in submission order, so waiting on the most recent overlapping one retires all the
+    // older ones too
+    const auto overlaps = [begin = range.offset, end = range.offset + range.size](const Fence &fence) {
+        return fence.begin < end && begin < fence.end;
+    };
+    const auto last = std::find_if(fences_.rbegin(), fences_.rend(), overlaps);
+    if (last == fences_.rend())
+        return;
+
+    GLenum result;
+    do
+    {
+        constexpr GLuint64 Timeout = 1000000000; // nanoseconds
+        result = glClientWaitSync(last->sync, GL_SYNC_FLUSH_COMMANDS_BIT, Timeout);
+    } while (result == GL_TIMEOUT_EXPIRED);
+
+    if (result == GL_WAIT_FAILED)
+        panic("glClientWaitSync failed\n");
+
+    const auto retired = fences_.rend() - last;
+    std::for_each(fences_.begin(), fences_.begin() + retired, [](const Fence &fence) {
+        glDeleteSync(fence.sync);
+    });
+    fences_.erase(fences_.begin(), fences_.begin() + retired);
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <GL/glew.h>
+
+#include <boost/noncopyable.hpp>
+
+#include <deque>
+
+// A persistently mapped, coherent buffer that is written front to back and wraps around. Each range handed
+// out by allocate() must be locked once the draw calls reading from it have been issued; allocate() only
+// blocks when it catches up with a range the GPU hasn't finished with yet.
+class RingBuffer : private boost::noncopyable
+{
+public:
+    RingBuffer(GLenum target, std::size_t size);
+    ~RingBuffer();
+
+    struct Range
+    {
+        std::size_t offset;
+        std::size_t size;
+        void *data;
+    };
+
+    GLuint id() const { return id_; }
+    std::size_t size() const { return size_; }
+
+    Range allocate(std::size_t size, std::size_t alignment);
+    void lock(const Range &range);
+
+private:
+    void wait_for(const Range &range);
+
+    struct Fence
+    {
+        GLsync sync;
+        std::size_t begin;
+        std::size_t end;
+    };
+
+    GLenum target_;
+    GLuint id_;
+    std::size_t size_;
+    std::size_t head_ = 0;
+    char *data_;
+    std::deque<Fence> fences_;
+};
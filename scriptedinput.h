@@ -0,0 +1,29 @@
+#pragma once
+
+#include <random>
+
+// Stands in for a player: holds a random dpad state for a random number of tics.
+class ScriptedInput
+{
+public:
+    explicit ScriptedInput(unsigned seed)
+        : rng_(seed)
+    {
+    }
+
+    unsigned next()
+    {
+        if (hold_tics_ == 0)
+        {
+            state_ = std::uniform_int_distribution<unsigned>(0, 31)(rng_);
+            hold_tics_ = std::uniform_int_distribution<int>(5, 60)(rng_);
+        }
+        --hold_tics_;
+        return state_;
+    }
+
+private:
+    std::mt19937 rng_;
+    unsigned state_ = 0;
+    int hold_tics_ = 0;
+};
@@ -0,0 +1,59 @@
+import json
+import random
+import struct
+import zlib
+
+# star field tiles for the scrolling background layers, written straight to a tilesheet page
+
+tile_size = 16
+far_tiles = 4
+near_tiles = 4
+
+random.seed(1234)
+
+def far_tile():
+    pixels = {}
+    for i in range(random.randint(1, 3)):
+        x, y = random.randrange(tile_size), random.randrange(tile_size)
+        v = random.randint(60, 140)
+        pixels[(x, y)] = (v, v, min(255, v + 60), 255)
+    return pixels
+
+def near_tile():
+    pixels = {}
+    if random.random() < 0.75:
+        x, y = random.randrange(2, tile_size - 2), random.randrange(2, tile_size - 2)
+        pixels[(x, y)] = (255, 255, 255, 255)
+        for dx, dy in ((-1, 0), (1, 0), (0, -1), (0, 1)):
+            pixels[(x + dx, y + dy)] = (140, 140, 255, 255)
+    else:
+        x, y = random.randrange(tile_size), random.randrange(tile_size)
+        pixels[(x, y)] = (200, 200, 255, 255)
+    return pixels
+
+def write_png(path, width, height, pixels):
+    def chunk(kind, data):
+        body = kind + data
+        return struct.pack('>I', len(data)) + body + struct.pack('>I', zlib.crc32(body) & 0xffffffff)
+    rows = b''
+    for y in range(height):
+        rows += b'\0' + b''.join(bytes(pixels.get((x, y), (0, 0, 0, 0))) for x in range(width))
+    with open(path, 'wb') as f:
+        f.write(b'\x89PNG\r\n\x1a\n')
+        f.write(chunk(b'IHDR', struct.pack('>IIBBBBB', width, height, 8, 6, 0, 0, 0)))
+        f.write(chunk(b'IDAT', zlib.compress(rows)))
+        f.write(chunk(b'IEND', b''))
+
+tiles = [('far-%d.png' % i, far_tile()) for i in range(far_tiles)] + \
+        [('near-%d.png' % i, near_tile()) for i in range(near_tiles)]
+
+page = {}
+sprites = []
+for i, (name, pixels) in enumerate(tiles):
+    for (x, y), color in pixels.items():
+        page[(x + i * tile_size, y)] = color
+    sprites.append({'texture': 0, 'position': [i * tile_size, 0], 'size': [tile_size, tile_size], 'name': name})
+
+write_png('resources/tilesheets/background.0.png', len(tiles) * tile_size, tile_size, page)
+with open('resources/tilesheets/background.json', 'w') as f:
+    json.dump({'textures': ['resources/tilesheets/background.0.png'], 'sprites': sprites}, f, separators=(',', ':'))
@@ -0,0 +1,169 @@
+#include "session.h"
+
+#include <algorithm>
+#include <cassert>
+
+namespace
+{
+constexpr auto ChecksummedLocalStates = 4; // enough to still have them when the other side reports back
+}
+
+Session::Session(const Level *level, int width, int height, const Settings &settings)
+    : settings_(settings)
+    , local_(width, height)
+    , remote_(width, height)
+    , local_inputs_(settings_.input_delay + 1, 0)
+    // the other side can be up to max_rollback tics ahead of us, and both sides delay their input
+    , remote_inputs_(2 * (settings_.max_rollback + settings_.input_delay) + 1, 0)
+    , predicted_inputs_(settings_.max_rollback + 1, 0)
+    , confirmed_remote_tic_(settings_.input_delay) // no input during the remote side's delay
+{
+    local_.initialize_level(level);
+    remote_.initialize_level(level);
+    remote_states_.assign(settings_.max_rollback + 1, remote_);
+    if (settings_.checksum_interval > 0)
+        checksummed_local_states_.assign(ChecksummedLocalStates, local_);
+}
+
+bool Session::advance(unsigned local_dpad_state, Input &local_input)
+{
+    if (rollback_tic_ != -1)
+        roll_back();
+
+    check_remote_checksums();
+
+    if (tic_ - confirmed_remote_tic_ >= settings_.max_rollback)
+    {
+        ++stats_.stalled_tics;
+        return false;
+    }
+
+    ++tic_;
+
+    // the input is used input_delay tics from now, this tic takes what was scheduled that long ago
+    const auto delayed_tic = tic_ + settings_.input_delay;
+    local_inputs_[delayed_tic % local_inputs_.size()] = local_dpad_state;
+    local_.advance(local_inputs_[tic_ % local_inputs_.size()]);
+    local_input = {static_cast<uint32_t>(delayed_tic), local_dpad_state};
+    if (settings_.checksum_interval > 0 && tic_ % settings_.checksum_interval == 0)
+        checksummed_local_states_[tic_ / settings_.checksum_interval % checksummed_local_states_.size()] = local_;
+
+    const auto remote_dpad_state = this->remote_dpad_state(tic_);
+    predicted_inputs_[tic_ % predicted_inputs_.size()] = remote_dpad_state;
+    remote_.advance(remote_dpad_state);
+    remote_states_[tic_ % remote_states_.size()] = remote_;
+
+    return true;
+}
+
+void Session::add_remote_input(const Input &input)
+{
+    const int tic = input.tic;
+    assert(tic == confirmed_remote_tic_ + 1);
+    assert(tic - tic_ < static_cast<int>(remote_inputs_.size()));
+
+    remote_inputs_[tic % remote_inputs_.size()] = input.dpad_state;
+    confirmed_remote_tic_ = tic;
+
+    // already simulated with a prediction?
+    if (tic <= tic_ && predicted_inputs_[tic % predicted_inputs_.size()] != input.dpad_state && rollback_tic_ == -1)
+        rollback_tic_ = tic;
+}
+
+bool Session::local_checksum(Checksum &checksum) const
+{
+    if (settings_.checksum_interval <= 0 || tic_ == 0 || tic_ % settings_.checksum_interval != 0)
+        return false;
+    checksum = {static_cast<uint32_t>(tic_), local_.wire_checksum()};
+    return true;
+}
+
+void Session::add_remote_checksum(const Checksum &checksum)
+{
+    remote_checksums_.push_back(checksum);
+}
+
+std::vector<Session::Desync> Session::take_desyncs()
+{
+    std::vector<Desync> desyncs;
+    desyncs.swap(desyncs_);
+    return desyncs;
+}
+
+const World *Session::checksummed_local_state(int tic) const
+{
+    if (checksummed_local_states_.empty() || tic <= 0 || tic % settings_.checksum_interval != 0)
+        return nullptr;
+    const auto &state = checksummed_local_states_[tic / settings_.checksum_interval % checksummed_local_states_.size()];
+    return state.tic() == tic ? &state : nullptr;
+}
+
+void Session::check_remote_checksums()
+{
+    assert(rollback_tic_ == -1);
+
+    const auto confirmed_tic = std::min(tic_, confirmed_remote_tic_);
+
+    auto it = remote_checksums_.begin();
+    while (it != remote_checksums_.end())
+    {
+        const int tic = it->tic;
+        if (tic > confirmed_tic)
+        {
+            ++it;
+            continue;
+        }
+
+        if (tic_ - tic < static_cast<int>(remote_states_.size()))
+        {
+            const auto &state = remote_states_[tic % remote_states_.size()];
+            assert(state.tic() == tic);
+            ++stats_.checksums_checked;
+            if (state.wire_checksum() != it->value)
+            {
+                ++stats_.desyncs;
+                desyncs_.push_back({tic, state});
+            }
+        }
+
+        it = remote_checksums_.erase(it);
+    }
+}
+
+const World *Session::confirmed_remote_state(int &tic) const
+{
+    tic = std::min(tic_, confirmed_remote_tic_);
+    if (rollback_tic_ != -1 && rollback_tic_ <= tic)
+        return nullptr;
+    if (tic_ - tic >= static_cast<int>(remote_states_.size()))
+        return nullptr;
+    return &remote_states_[tic % remote_states_.size()];
+}
+
+unsigned Session::remote_dpad_state(int tic) const
+{
+    // past the last confirmed input, repeat it
+    tic = std::min(tic, confirmed_remote_tic_);
+    if (tic <= settings_.input_delay)
+        return 0;
+    return remote_inputs_[tic % remote_inputs_.size()];
+}
+
+void Session::roll_back()
+{
+    assert(rollback_tic_ > 0 && rollback_tic_ <= tic_);
+    assert(tic_ - rollback_tic_ < static_cast<int>(remote_states_.size()));
+
+    remote_ = remote_states_[(rollback_tic_ - 1) % remote_states_.size()];
+    for (int tic = rollback_tic_; tic <= tic_; ++tic)
+    {
+        const auto dpad_state = remote_dpad_state(tic);
+        predicted_inputs_[tic % predicted_inputs_.size()] = dpad_state;
+        remote_.advance(dpad_state);
+        remote_states_[tic % remote_states_.size()] = remote_;
+    }
+
+    ++stats_.rollbacks;
+    stats_.resimulated_tics += tic_ - rollback_tic_ + 1;
+    rollback_tic_ = -1;
+}
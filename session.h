@@ -0,0 +1,103 @@
+#pragma once
+
+#include "world.h"
+
+#include <cstdint>
+#include <vector>
+
+struct Level;
+
+// Both worlds of a two player match, without any networking or GL. The local world runs on local input,
+// delayed by input_delay tics. The remote world runs ahead of the remote input on predicted input (the
+// last one confirmed, repeated); when the real input turns out to be different it's rolled back to the
+// last state that was right and re-simulated.
+class Session
+{
+public:
+    struct Settings
+    {
+        int input_delay = 2; // tics
+        int max_rollback = 8; // tics the remote world may run ahead of confirmed input
+        int checksum_interval = 30; // tics between checksums for the other side, 0 for none
+    };
+
+    struct Stats
+    {
+        int rollbacks = 0;
+        int resimulated_tics = 0;
+        int stalled_tics = 0; // waiting for remote input, beyond max_rollback
+        int checksums_checked = 0;
+        int desyncs = 0;
+    };
+
+    struct Input
+    {
+        uint32_t tic;
+        unsigned dpad_state;
+    };
+
+    struct Checksum
+    {
+        uint32_t tic;
+        uint32_t value;
+    };
+
+    // a remote world checksum that didn't match the one the other side had for its local world
+    struct Desync
+    {
+        int tic;
+        World remote_state;
+    };
+
+    Session(const Level *level, int width, int height, const Settings &settings);
+
+    // Schedules local input and advances both worlds by one tic. Returns the input to send to the other
+    // side, or nothing if the remote world can't run ahead any further (then nothing is scheduled).
+    bool advance(unsigned local_dpad_state, Input &local_input);
+
+    // Remote input has to arrive in tic order.
+    void add_remote_input(const Input &input);
+
+    // The local world's checksum after the tic just advanced, if it's one the other side should check.
+    bool local_checksum(Checksum &checksum) const;
+
+    // Checked against the remote world once its input is confirmed up to there. Anything too old to
+    // still be in the rollback window by then goes unchecked.
+    void add_remote_checksum(const Checksum &checksum);
+
+    // mismatches found since the last call
+    std::vector<Desync> take_desyncs();
+
+    // the local world as of a recent checksummed tic, for dumping when the other side reports a desync
+    const World *checksummed_local_state(int tic) const;
+
+    int tic() const { return tic_; }
+    int confirmed_remote_tic() const { return confirmed_remote_tic_; }
+    const World &local() const { return local_; }
+    const World &remote() const { return remote_; } // possibly predicted
+    const Stats &stats() const { return stats_; }
+
+    // The remote world after tic, the last one with all of its input confirmed, for comparing against the
+    // other side's local world. Null if tic fell out of the rollback window or still needs a rollback.
+    const World *confirmed_remote_state(int &tic) const;
+
+private:
+    unsigned remote_dpad_state(int tic) const; // confirmed or predicted
+    void roll_back();
+    void check_remote_checksums();
+
+    Settings settings_;
+    World local_;
+    World remote_;
+    int tic_ = 0;
+    std::vector<unsigned> local_inputs_; // indexed by tic % size
+    std::vector<unsigned> remote_inputs_; // confirmed only, indexed by tic % size
+    std::vector<unsigned> predicted_inputs_; // what the remote world was advanced with, by tic % size
+    std::vector<World> remote_states_; // after each tic, by tic % size
+    int confirmed_remote_tic_; // remote input is known up to here
+    int rollback_tic_ = -1; // first tic that was mispredicted, if any
+    std::vector<Checksum> remote_checksums_; // not checked yet
+    std::vector<World> checksummed_local_states_; // by tic / checksum_interval % size
+    std::vector<Desync> desyncs_;
+    Stats stats_;
+};
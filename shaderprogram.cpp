@@ -2,11 +2,72 @@
 
 #include "panic.h"
 #include "fileutil.h"
+#include "renderstate.h"
 
+#include <algorithm>
 #include <array>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+#include <sys/stat.h>
 
 #include <glm/gtc/type_ptr.hpp>
 
+namespace
+{
+constexpr auto ShaderCacheDirectory = "shadercache";
+
+bool g_parallel_compile = false;
+ShaderProgram::StartupStats g_startup_stats;
+
+// accumulates the time spent in the enclosing scope into the startup stats
+class StartupTimer
+{
+public:
+    StartupTimer()
+        : start_(std::chrono::steady_clock::now())
+    { }
+
+    ~StartupTimer()
+    {
+        const std::chrono::duration<float, std::milli> elapsed = std::chrono::steady_clock::now() - start_;
+        g_startup_stats.milliseconds += elapsed.count();
+    }
+
+private:
+    std::chrono::steady_clock::time_point start_;
+};
+
+// FNV-1a
+uint64_t hash_bytes(uint64_t hash, const void *data, std::size_t size)
+{
+    const auto *bytes = static_cast<const unsigned char *>(data);
+    for (std::size_t i = 0; i < size; ++i)
+    {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3;
+    }
+    return hash;
+}
+
+uint64_t hash_string(uint64_t hash, const char *str)
+{
+    return hash_bytes(hash, str, std::strlen(str));
+}
+
+// binary cache file layout: header followed by the program binary
+struct BinaryHeader
+{
+    uint32_t magic;
+    uint32_t format;
+    uint32_t length;
+};
+constexpr uint32_t BinaryMagic = 0x5a535042; // 'ZSPB'
+}
+
 ShaderProgram::ShaderProgram()
     : id_(glCreateProgram())
 {
@@ -14,55 +75,234 @@ ShaderProgram::ShaderProgram()
 
 ShaderProgram::~ShaderProgram()
 {
+    for (const auto &shader : shaders_)
+    {
+        if (shader.id)
+            glDeleteShader(shader.id);
+    }
+    program_deleted(id_);
     glDeleteProgram(id_);
 }
 
+void ShaderProgram::enable_parallel_compile()
+{
+#ifdef GL_KHR_parallel_shader_compile
+    if (GLEW_KHR_parallel_shader_compile)
+    {
+        glMaxShaderCompilerThreadsKHR(0xffffffff); // as many as the implementation likes
+        g_parallel_compile = true;
+        return;
+    }
+#endif
+    if (GLEW_ARB_parallel_shader_compile)
+    {
+        glMaxShaderCompilerThreadsARB(0xffffffff);
+        g_parallel_compile = true;
+    }
+}
+
+const ShaderProgram::StartupStats &ShaderProgram::startup_stats()
+{
+    return g_startup_stats;
+}
+
 void ShaderProgram::add_shader(GLenum type, const std::string &filename)
 {
-    const auto source = load_file(filename);
+    StartupTimer timer;
+    shaders_.push_back({type, filename, load_file(filename), 0});
+}
 
-    const auto shader_id = glCreateShader(type);
+void ShaderProgram::link()
+{
+    {
+        StartupTimer timer;
 
-    const auto source_ptr = source.data();
-    glShaderSource(shader_id, 1, &source_ptr, nullptr);
-    glCompileShader(shader_id);
+        ++g_startup_stats.programs;
 
-    int status;
-    glGetShaderiv(shader_id, GL_COMPILE_STATUS, &status);
-    if (!status)
+        if (load_binary())
+        {
+            ++g_startup_stats.cache_hits;
+            linked_ = true;
+            resolve_uniform_locations();
+            return;
+        }
+
+        compile_and_link();
+    }
+
+    // times itself, as it does when called later for a parallel compile
+    if (!g_parallel_compile)
+        finish_link();
+}
+
+void ShaderProgram::wait_until_linked() const
+{
+    // finishing the link is invisible to users of the program, so it's fine to do it from const methods
+    if (!linked_)
+        const_cast<ShaderProgram *>(this)->finish_link();
+}
+
+std::string ShaderProgram::cache_path() const
+{
+    // the binary is only valid for the same sources on the same driver
+    uint64_t hash = 0xcbf29ce484222325;
+    for (const auto name : {GL_VENDOR, GL_RENDERER, GL_VERSION, GL_SHADING_LANGUAGE_VERSION})
+        hash = hash_string(hash, reinterpret_cast<const char *>(glGetString(name)));
+    for (const auto &shader : shaders_)
     {
-        std::array<GLchar, 64 * 1024> buf;
-        GLsizei length;
-        glGetShaderInfoLog(shader_id, buf.size() - 1, &length, buf.data());
-        panic("failed to compile shader %s:\n%.*s", std::string(filename).c_str(), length, buf.data());
+        hash = hash_bytes(hash, &shader.type, sizeof(shader.type));
+        hash = hash_string(hash, shader.source.data());
     }
 
-    glAttachShader(id_, shader_id);
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016" PRIx64 ".bin", hash);
+    return std::string(ShaderCacheDirectory) + "/" + name;
 }
 
-void ShaderProgram::link()
+bool ShaderProgram::load_binary()
+{
+    std::ifstream file(cache_path(), std::ios::binary);
+    if (!file.is_open())
+        return false;
+
+    BinaryHeader header;
+    if (!file.read(reinterpret_cast<char *>(&header), sizeof(header)) || header.magic != BinaryMagic)
+        return false;
+
+    std::vector<char> binary(header.length);
+    if (!file.read(binary.data(), binary.size()))
+        return false;
+
+    glProgramBinary(id_, header.format, binary.data(), binary.size());
+
+    // the driver is free to reject binaries, e.g. after an update
+    int status;
+    glGetProgramiv(id_, GL_LINK_STATUS, &status);
+    return status;
+}
+
+void ShaderProgram::save_binary() const
 {
+    int length;
+    glGetProgramiv(id_, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length == 0)
+        return;
+
+    std::vector<char> binary(length);
+    GLenum format;
+    glGetProgramBinary(id_, length, nullptr, &format, binary.data());
+
+    mkdir(ShaderCacheDirectory, 0755);
+
+    std::ofstream file(cache_path(), std::ios::binary);
+    if (!file.is_open())
+        return;
+
+    const BinaryHeader header{BinaryMagic, format, static_cast<uint32_t>(length)};
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    file.write(binary.data(), binary.size());
+}
+
+void ShaderProgram::compile_and_link()
+{
+    for (auto &shader : shaders_)
+    {
+        shader.id = glCreateShader(shader.type);
+
+        const auto source_ptr = shader.source.data();
+        glShaderSource(shader.id, 1, &source_ptr, nullptr);
+        glCompileShader(shader.id);
+
+        glAttachShader(id_, shader.id);
+    }
+
+    glProgramParameteri(id_, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
     glLinkProgram(id_);
+}
+
+void ShaderProgram::finish_link()
+{
+    StartupTimer timer;
+
+    // querying the status is what waits for a parallel compile
+    for (auto &shader : shaders_)
+    {
+        int status;
+        glGetShaderiv(shader.id, GL_COMPILE_STATUS, &status);
+        if (!status)
+        {
+            std::array<GLchar, 64 * 1024> buf;
+            GLsizei length;
+            glGetShaderInfoLog(shader.id, buf.size() - 1, &length, buf.data());
+            panic("failed to compile shader %s:\n%.*s", shader.path.c_str(), length, buf.data());
+        }
+    }
 
     int status;
     glGetProgramiv(id_, GL_LINK_STATUS, &status);
     if (!status)
         panic("failed to link shader program\n");
+
+    for (auto &shader : shaders_)
+    {
+        glDetachShader(id_, shader.id);
+        glDeleteShader(shader.id);
+        shader.id = 0;
+    }
+
+    linked_ = true;
+
+    save_binary();
+    resolve_uniform_locations();
+}
+
+void ShaderProgram::resolve_uniform_locations()
+{
+    int uniform_count;
+    glGetProgramiv(id_, GL_ACTIVE_UNIFORMS, &uniform_count);
+
+    int max_name_length;
+    glGetProgramiv(id_, GL_ACTIVE_UNIFORM_MAX_LENGTH, &max_name_length);
+
+    uniform_locations_.clear();
+
+    std::vector<GLchar> name(max_name_length);
+    for (int i = 0; i < uniform_count; ++i)
+    {
+        GLsizei length;
+        glGetActiveUniformName(id_, i, name.size(), &length, name.data());
+
+        // arrays are reported as "name[0]", look them up by the plain name
+        std::string_view uniform_name(name.data(), length);
+        constexpr std::string_view ArraySuffix = "[0]";
+        if (uniform_name.size() > ArraySuffix.size() &&
+            uniform_name.substr(uniform_name.size() - ArraySuffix.size()) == ArraySuffix)
+            uniform_name.remove_suffix(ArraySuffix.size());
+
+        const auto location = glGetUniformLocation(id_, name.data());
+        if (location != -1) // uniforms in blocks don't have a location
+            uniform_locations_.emplace_back(uniform_name, location);
+    }
 }
 
 void ShaderProgram::bind() const
 {
-    glUseProgram(id_);
+    wait_until_linked();
+    bind_program(id_);
 }
 
 void ShaderProgram::unbind()
 {
-    glUseProgram(0);
+    bind_program(0);
 }
 
 int ShaderProgram::uniform_location(std::string_view name) const
 {
-    return glGetUniformLocation(id_, name.data());
+    wait_until_linked();
+    auto it = std::find_if(uniform_locations_.begin(), uniform_locations_.end(), [name](const auto &uniform) {
+        return uniform.first == name;
+    });
+    return it != uniform_locations_.end() ? it->second : -1;
 }
 
 void ShaderProgram::set_uniform(int location, int value) const
@@ -4,7 +4,9 @@
 
 #include <array>
 #include <vector>
+#include <string>
 #include <string_view>
+#include <utility>
 
 #include <boost/noncopyable.hpp>
 
@@ -16,13 +18,25 @@ public:
     ShaderProgram();
     ~ShaderProgram();
 
+    // Shaders are only compiled if there's no usable binary in the program cache. With parallel compilation
+    // link() doesn't wait for the driver; the first bind() or uniform_location() does.
     void add_shader(GLenum type, const std::string &path);
     void link();
 
+    static void enable_parallel_compile(); // if GL_KHR_parallel_shader_compile is supported
+
+    struct StartupStats
+    {
+        int programs = 0;
+        int cache_hits = 0;
+        float milliseconds = 0.0f; // spent in ShaderProgram setting up programs
+    };
+    static const StartupStats &startup_stats();
+
     void bind() const;
     static void unbind();
 
-    int uniform_location(std::string_view name) const;
+    int uniform_location(std::string_view name) const; // -1 if not an active uniform
 
     void set_uniform(int location, int v) const;
     void set_uniform(int location, float v) const;
@@ -39,5 +53,24 @@ public:
     void set_uniform(int location, const glm::mat4 &mat) const;
 
 private:
+    struct Shader
+    {
+        GLenum type;
+        std::string path;
+        std::vector<char> source;
+        GLuint id;
+    };
+
+    std::string cache_path() const;
+    bool load_binary();
+    void save_binary() const;
+    void compile_and_link();
+    void wait_until_linked() const;
+    void finish_link();
+    void resolve_uniform_locations();
+
     GLuint id_;
+    std::vector<Shader> shaders_;
+    bool linked_ = false;
+    std::vector<std::pair<std::string, int>> uniform_locations_;
 };
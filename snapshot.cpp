@@ -0,0 +1,356 @@
+#include "snapshot.h"
+
+#include <algorithm>
+#include <cassert>
+
+namespace
+{
+constexpr auto TicBits = 32;
+constexpr auto PositionBits = 16; // signed, plenty for anywhere near the screen
+
+// counters the World decrements every tic
+int count_down(int tics)
+{
+    return std::max(tics - 1, 0);
+}
+
+template<typename Entity>
+glm::ivec2 predict_position(const Entity &base, const std::vector<Entity> &previous)
+{
+    const auto it = std::lower_bound(previous.begin(), previous.end(), base.id,
+                                     [](const Entity &entity, uint32_t id) { return entity.id < id; });
+    if (it == previous.end() || it->id != base.id)
+        return base.position;
+    return 2 * base.position - it->position;
+}
+
+void put_position(BitWriter &writer, const glm::ivec2 &position, RiceContext &dx, RiceContext &dy)
+{
+    writer.put_signed_rice(position.x, dx);
+    writer.put_signed_rice(position.y, dy);
+}
+
+bool get_position(BitReader &reader, glm::ivec2 &position, RiceContext &dx, RiceContext &dy)
+{
+    int32_t x, y;
+    if (!reader.get_signed_rice(x, dx) || !reader.get_signed_rice(y, dy))
+        return false;
+    position = {x, y};
+    return true;
+}
+
+bool get_field(BitReader &reader, int &value, int predicted, RiceContext &context)
+{
+    int32_t residual;
+    if (!reader.get_signed_rice(residual, context))
+        return false;
+    value = predicted + residual;
+    return true;
+}
+
+// Everything besides id and position, against base, or for a new entity against nothing.
+
+void put_fields(BitWriter &writer, RiceContext *contexts, const Snapshot::Foe &foe, const Snapshot::Foe *base)
+{
+    if (!base)
+        writer.put_rice(foe.type, contexts[0]);
+    writer.put_signed_rice(foe.frame - (base ? base->frame : 0), contexts[1]);
+    writer.put_signed_rice(foe.damage_tics - (base ? count_down(base->damage_tics) : 0), contexts[2]);
+}
+
+bool get_fields(BitReader &reader, RiceContext *contexts, Snapshot::Foe &foe, const Snapshot::Foe *base)
+{
+    if (!base)
+    {
+        uint32_t type;
+        if (!reader.get_rice(type, contexts[0]))
+            return false;
+        foe.type = type;
+    }
+    else
+    {
+        foe.type = base->type;
+    }
+    return get_field(reader, foe.frame, base ? base->frame : 0, contexts[1]) &&
+           get_field(reader, foe.damage_tics, base ? count_down(base->damage_tics) : 0, contexts[2]);
+}
+
+void put_fields(BitWriter &, RiceContext *, const Snapshot::Missile &, const Snapshot::Missile *)
+{
+}
+
+bool get_fields(BitReader &, RiceContext *, Snapshot::Missile &, const Snapshot::Missile *)
+{
+    return true;
+}
+
+void put_fields(BitWriter &writer, RiceContext *contexts, const Snapshot::Explosion &explosion,
+                const Snapshot::Explosion *base)
+{
+    writer.put_signed_rice(explosion.frame - (base ? base->frame + 1 : 0), contexts[1]);
+}
+
+bool get_fields(BitReader &reader, RiceContext *contexts, Snapshot::Explosion &explosion,
+                const Snapshot::Explosion *base)
+{
+    return get_field(reader, explosion.frame, base ? base->frame + 1 : 0, contexts[1]);
+}
+}
+
+bool Snapshot::operator==(const Snapshot &other) const
+{
+    const auto same_player = player.position == other.player.position && player.frame == other.player.frame &&
+                             player.fire_tics == other.player.fire_tics;
+    const auto same_foes = std::equal(foes.begin(), foes.end(), other.foes.begin(), other.foes.end(),
+                                      [](const Foe &a, const Foe &b) {
+                                          return a.id == b.id && a.type == b.type && a.position == b.position &&
+                                                 a.frame == b.frame && a.damage_tics == b.damage_tics;
+                                      });
+    const auto same_missiles = std::equal(missiles.begin(), missiles.end(), other.missiles.begin(),
+                                          other.missiles.end(), [](const Missile &a, const Missile &b) {
+                                              return a.id == b.id && a.position == b.position;
+                                          });
+    const auto same_explosions = std::equal(explosions.begin(), explosions.end(), other.explosions.begin(),
+                                            other.explosions.end(), [](const Explosion &a, const Explosion &b) {
+                                                return a.id == b.id && a.position == b.position &&
+                                                       a.frame == b.frame;
+                                            });
+    return tic == other.tic && same_player && same_foes && same_missiles && same_explosions;
+}
+
+void SnapshotCodec::encode(const Snapshot &snapshot, bool keyframe, BitWriter &writer)
+{
+    keyframe = keyframe || !have_baseline_;
+    if (keyframe)
+        start_keyframe();
+
+    writer.put_bit(keyframe);
+
+    // the player, which is always there
+    const auto &player = snapshot.player;
+    if (keyframe)
+    {
+        writer.put_bits(snapshot.tic, TicBits);
+        writer.put_bits(static_cast<uint16_t>(player.position.x), PositionBits);
+        writer.put_bits(static_cast<uint16_t>(player.position.y), PositionBits);
+        writer.put_signed_rice(player.frame, player_state_.fields[1]);
+        writer.put_signed_rice(player.fire_tics, player_state_.fields[2]);
+    }
+    else
+    {
+        const auto &base = baseline_.player;
+        const auto predicted = have_previous_ ? 2 * base.position - previous_.player.position : base.position;
+        writer.put_rice(snapshot.tic - baseline_.tic - 1, tic_context_);
+        put_position(writer, player.position - predicted, player_state_.dx, player_state_.dy);
+        writer.put_signed_rice(player.frame - base.frame, player_state_.fields[1]);
+        writer.put_signed_rice(player.fire_tics - count_down(base.fire_tics), player_state_.fields[2]);
+    }
+
+    encode_list(snapshot.foes, baseline_.foes, previous_.foes, player.position, foe_state_, writer);
+    encode_list(snapshot.missiles, baseline_.missiles, previous_.missiles, player.position, missile_state_, writer);
+    encode_list(snapshot.explosions, baseline_.explosions, previous_.explosions, player.position, explosion_state_,
+                writer);
+
+    set_baseline(snapshot, keyframe);
+}
+
+bool SnapshotCodec::decode(BitReader &reader, Snapshot &snapshot)
+{
+    bool keyframe;
+    if (!reader.get_bit(keyframe))
+        return false;
+
+    if (keyframe)
+    {
+        start_keyframe();
+    }
+    else if (!have_baseline_)
+    {
+        return false;
+    }
+
+    // from here on a failure leaves the state half updated, so nothing but a keyframe can follow
+    have_baseline_ = false;
+
+    auto &player = snapshot.player;
+    if (keyframe)
+    {
+        uint32_t tic, x, y;
+        if (!reader.get_bits(tic, TicBits) || !reader.get_bits(x, PositionBits) || !reader.get_bits(y, PositionBits))
+            return false;
+        snapshot.tic = tic;
+        player.position = {static_cast<int16_t>(x), static_cast<int16_t>(y)};
+        if (!get_field(reader, player.frame, 0, player_state_.fields[1]) ||
+            !get_field(reader, player.fire_tics, 0, player_state_.fields[2]))
+            return false;
+    }
+    else
+    {
+        const auto &base = baseline_.player;
+        const auto predicted = have_previous_ ? 2 * base.position - previous_.player.position : base.position;
+        uint32_t tic_delta;
+        glm::ivec2 residual;
+        if (!reader.get_rice(tic_delta, tic_context_) ||
+            !get_position(reader, residual, player_state_.dx, player_state_.dy))
+            return false;
+        snapshot.tic = baseline_.tic + 1 + tic_delta;
+        player.position = predicted + residual;
+        if (!get_field(reader, player.frame, base.frame, player_state_.fields[1]) ||
+            !get_field(reader, player.fire_tics, count_down(base.fire_tics), player_state_.fields[2]))
+            return false;
+    }
+
+    if (!decode_list(snapshot.foes, baseline_.foes, previous_.foes, player.position, foe_state_, reader) ||
+        !decode_list(snapshot.missiles, baseline_.missiles, previous_.missiles, player.position, missile_state_,
+                     reader) ||
+        !decode_list(snapshot.explosions, baseline_.explosions, previous_.explosions, player.position,
+                     explosion_state_, reader))
+        return false;
+
+    set_baseline(snapshot, keyframe);
+    return true;
+}
+
+void SnapshotCodec::reset()
+{
+    have_baseline_ = false;
+}
+
+void SnapshotCodec::start_keyframe()
+{
+    baseline_ = previous_ = Snapshot();
+    have_previous_ = false;
+    tic_context_ = RiceContext();
+    player_state_ = ListState();
+    foe_state_ = ListState();
+    missile_state_ = ListState();
+    explosion_state_ = ListState();
+}
+
+void SnapshotCodec::set_baseline(const Snapshot &snapshot, bool keyframe)
+{
+    if (keyframe)
+    {
+        previous_ = Snapshot();
+        have_previous_ = false;
+    }
+    else
+    {
+        previous_ = std::move(baseline_);
+        have_previous_ = true;
+    }
+    baseline_ = snapshot;
+    have_baseline_ = true;
+}
+
+template<typename Entity>
+void SnapshotCodec::encode_list(const std::vector<Entity> &entities, const std::vector<Entity> &baseline,
+                                const std::vector<Entity> &previous, const glm::ivec2 &origin, ListState &state,
+                                BitWriter &writer)
+{
+    // the ones still there come first and in the same order, anything after them is new
+    std::vector<std::size_t> removed;
+    std::size_t survivors = 0;
+    for (std::size_t i = 0; i < baseline.size(); ++i)
+    {
+        if (survivors < entities.size() && entities[survivors].id == baseline[i].id)
+            ++survivors;
+        else
+            removed.push_back(i);
+    }
+
+    writer.put_rice(removed.size(), state.removed);
+    std::size_t next_index = 0;
+    for (const auto index : removed)
+    {
+        writer.put_rice(index - next_index, state.removed_gap);
+        next_index = index + 1;
+    }
+
+    auto removed_it = removed.begin();
+    auto entity_it = entities.begin();
+    for (std::size_t i = 0; i < baseline.size(); ++i)
+    {
+        if (removed_it != removed.end() && *removed_it == i)
+        {
+            ++removed_it;
+            continue;
+        }
+        const auto &base = baseline[i];
+        const auto &entity = *entity_it++;
+        assert(entity.id == base.id);
+        put_position(writer, entity.position - predict_position(base, previous), state.dx, state.dy);
+        put_fields(writer, state.fields, entity, &base);
+    }
+
+    writer.put_rice(entities.size() - survivors, state.added);
+    auto spawn_origin = origin;
+    for (; entity_it != entities.end(); ++entity_it)
+    {
+        const auto &entity = *entity_it;
+        assert(entity.id > state.last_id);
+        writer.put_rice(entity.id - state.last_id - 1, state.id_gap);
+        put_position(writer, entity.position - spawn_origin, state.spawn_dx, state.spawn_dy);
+        put_fields(writer, state.fields, entity, static_cast<const Entity *>(nullptr));
+        state.last_id = entity.id;
+        spawn_origin = entity.position;
+    }
+}
+
+template<typename Entity>
+bool SnapshotCodec::decode_list(std::vector<Entity> &entities, const std::vector<Entity> &baseline,
+                                const std::vector<Entity> &previous, const glm::ivec2 &origin, ListState &state,
+                                BitReader &reader)
+{
+    entities.clear();
+
+    uint32_t removed_count;
+    if (!reader.get_rice(removed_count, state.removed) || removed_count > baseline.size())
+        return false;
+
+    std::vector<bool> removed(baseline.size(), false);
+    std::size_t next_index = 0;
+    for (uint32_t i = 0; i < removed_count; ++i)
+    {
+        uint32_t gap;
+        if (!reader.get_rice(gap, state.removed_gap) || next_index + gap >= baseline.size())
+            return false;
+        removed[next_index + gap] = true;
+        next_index += gap + 1;
+    }
+
+    for (std::size_t i = 0; i < baseline.size(); ++i)
+    {
+        if (removed[i])
+            continue;
+        const auto &base = baseline[i];
+        Entity entity = base;
+        glm::ivec2 residual;
+        if (!get_position(reader, residual, state.dx, state.dy) ||
+            !get_fields(reader, state.fields, entity, &base))
+            return false;
+        entity.position = predict_position(base, previous) + residual;
+        entities.push_back(entity);
+    }
+
+    uint32_t added_count;
+    if (!reader.get_rice(added_count, state.added))
+        return false;
+    auto spawn_origin = origin;
+    for (uint32_t i = 0; i < added_count; ++i)
+    {
+        uint32_t id_gap;
+        glm::ivec2 offset;
+        Entity entity;
+        if (!reader.get_rice(id_gap, state.id_gap) || !get_position(reader, offset, state.spawn_dx, state.spawn_dy) ||
+            !get_fields(reader, state.fields, entity, static_cast<const Entity *>(nullptr)))
+            return false;
+        entity.id = state.last_id + 1 + id_gap;
+        entity.position = spawn_origin + offset;
+        entities.push_back(entity);
+        state.last_id = entity.id;
+        spawn_origin = entity.position;
+    }
+
+    return true;
+}
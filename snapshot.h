@@ -0,0 +1,111 @@
+#pragma once
+
+#include "bitstream.h"
+
+#include <glm/vec2.hpp>
+
+#include <cstdint>
+#include <vector>
+
+// What a spectator needs to see of a World, without simulating it. Positions are quantized to
+// 1/PositionScale pixels. Every list is ordered by entity id, as in the World, which only ever appends
+// with fresh ids.
+struct Snapshot
+{
+    static constexpr int PositionScale = 4;
+
+    struct Player
+    {
+        glm::ivec2 position = {0, 0};
+        int frame = 0;
+        int fire_tics = 0;
+    };
+
+    struct Foe
+    {
+        uint32_t id;
+        int type;
+        glm::ivec2 position;
+        int frame;
+        int damage_tics;
+    };
+
+    struct Missile
+    {
+        uint32_t id;
+        glm::ivec2 position;
+    };
+
+    struct Explosion
+    {
+        uint32_t id;
+        glm::ivec2 position;
+        int frame;
+    };
+
+    int tic = 0;
+    Player player;
+    std::vector<Foe> foes;
+    std::vector<Missile> missiles;
+    std::vector<Explosion> explosions;
+
+    bool operator==(const Snapshot &other) const;
+    bool operator!=(const Snapshot &other) const { return !(*this == other); }
+};
+
+// One end of a spectator stream, the same class at both ends. A keyframe is coded on its own; everything
+// else is a delta against the snapshot coded before it: removed entities by index, surviving ones as the
+// difference to where they'd be had they kept moving like the tic before, new ones relative to the player
+// or the entity added before them. Everything is Golomb-Rice coded through adaptive contexts.
+//
+// Both ends have to see the same sequence of snapshots, so after losing a delta a spectator has to wait for
+// the next keyframe.
+class SnapshotCodec
+{
+public:
+    void encode(const Snapshot &snapshot, bool keyframe, BitWriter &writer);
+
+    // false if the data is malformed, or a delta without what it's against
+    bool decode(BitReader &reader, Snapshot &snapshot);
+
+    // forget the baseline, only a keyframe can be decoded next
+    void reset();
+
+private:
+    // per entity list, reset with every keyframe
+    struct ListState
+    {
+        uint32_t last_id = 0; // of the newest entity coded so far, ids only go up
+        RiceContext removed;
+        RiceContext removed_gap;
+        RiceContext added;
+        RiceContext id_gap;
+        RiceContext dx;
+        RiceContext dy;
+        RiceContext spawn_dx;
+        RiceContext spawn_dy;
+        RiceContext fields[3];
+    };
+
+    template<typename Entity>
+    void encode_list(const std::vector<Entity> &entities, const std::vector<Entity> &baseline,
+                     const std::vector<Entity> &previous, const glm::ivec2 &origin, ListState &state,
+                     BitWriter &writer);
+    template<typename Entity>
+    bool decode_list(std::vector<Entity> &entities, const std::vector<Entity> &baseline,
+                     const std::vector<Entity> &previous, const glm::ivec2 &origin, ListState &state,
+                     BitReader &reader);
+
+    void start_keyframe();
+    void set_baseline(const Snapshot &snapshot, bool keyframe);
+
+    bool have_baseline_ = false;
+    bool have_previous_ = false;
+    Snapshot baseline_; // the last one coded
+    Snapshot previous_; // the one before that, for how things moved
+    RiceContext tic_context_;
+    ListState player_state_;
+    ListState foe_state_;
+    ListState missile_state_;
+    ListState explosion_state_;
+};
@@ -0,0 +1,181 @@
+#include "panic.h"
+
+#include "tilesheet.h"
+#include "trajectory.h"
+#include "level.h"
+#include "world.h"
+#include "foeclass.h"
+#include "snapshot.h"
+#include "scriptedinput.h"
+#include "gameconstants.h"
+#include "udpchannel.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdlib>
+#include <iostream>
+
+#include <unistd.h>
+
+// What a spectator of a match on the shipped level costs: both players' worlds run on scripted input, every
+// tic is coded like the match server codes it for spectators, decoded again and checked against the
+// original. Reports bytes per second against sending the full state every tic.
+
+namespace
+{
+// what MatchWorker puts around the two snapshots: type, session id, seq, then a size for each
+constexpr auto DatagramHeaderSize = 1 + 4 + 2 + 2 * 2;
+constexpr auto UdpIpHeaderSize = 8 + 20;
+
+struct Sizes
+{
+    int count = 0;
+    long total = 0;
+    int max = 0;
+
+    void add(int size)
+    {
+        ++count;
+        total += size;
+        max = std::max(max, size);
+    }
+
+    double mean() const { return count ? static_cast<double>(total) / count : 0; }
+};
+
+// a plain serialization: floats for positions, ids and types in full
+int full_state_size(const Snapshot &snapshot)
+{
+    constexpr auto PlayerSize = 4 + 4 + 1 + 1;
+    constexpr auto FoeSize = 4 + 1 + 4 + 4 + 1 + 1;
+    constexpr auto MissileSize = 4 + 4 + 4;
+    constexpr auto ExplosionSize = 4 + 4 + 4 + 1;
+    return 4 + PlayerSize + 3 * 2 + snapshot.foes.size() * FoeSize + snapshot.missiles.size() * MissileSize +
+           snapshot.explosions.size() * ExplosionSize;
+}
+}
+
+static void usage(const char *argv0)
+{
+    std::cerr << "usage: " << argv0 << " [-t seconds] [-k keyframe_interval] [-r seed]\n";
+    std::exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+    int seconds = 20; // about as long as the shipped level has foes
+    int keyframe_interval = TicsPerSecond;
+    unsigned seed = 1;
+
+    int c;
+    while ((c = getopt(argc, argv, "t:k:r:")) != EOF)
+    {
+        switch (c)
+        {
+            case 't':
+                seconds = std::atoi(optarg);
+                break;
+
+            case 'k':
+                keyframe_interval = std::atoi(optarg);
+                break;
+
+            case 'r':
+                seed = std::strtoul(optarg, nullptr, 10);
+                break;
+
+            default:
+                usage(argv[0]);
+        }
+    }
+
+    if (seconds <= 0 || keyframe_interval <= 0)
+        usage(argv[0]);
+
+    cache_tilesheet("resources/tilesheets/sheet.json");
+    initialize_foe_classes();
+
+    {
+        const auto level = load_level("resources/levels/level-0.json");
+
+        struct Stream
+        {
+            Stream(const Level *level, unsigned seed)
+                : world(ViewportWidth, ViewportHeight)
+                , input(seed)
+            {
+                world.initialize_level(level);
+            }
+
+            World world;
+            ScriptedInput input;
+            SnapshotCodec encoder;
+            SnapshotCodec decoder;
+        };
+        std::array<Stream, 2> streams = {Stream(level.get(), seed), Stream(level.get(), seed + 1)};
+
+        Sizes keyframes, deltas, datagrams, full_states;
+        int max_entities = 0;
+        Snapshot snapshot, decoded;
+        BitWriter writer;
+
+        const int tics = seconds * TicsPerSecond;
+        for (int tic = 0; tic < tics; ++tic)
+        {
+            const auto keyframe = tic % keyframe_interval == 0;
+            std::array<int, 2> sizes;
+            int full_state = 0;
+
+            for (int i = 0; i < 2; ++i)
+            {
+                auto &stream = streams[i];
+                stream.world.advance(stream.input.next());
+                stream.world.snapshot(snapshot);
+
+                writer.clear();
+                stream.encoder.encode(snapshot, keyframe, writer);
+
+                BitReader reader(writer.data().data(), writer.data().size());
+                if (!stream.decoder.decode(reader, decoded) || decoded != snapshot)
+                    panic("snapshot didn't survive coding at tic %d\n", snapshot.tic);
+
+                const int size = writer.data().size();
+                (keyframe ? keyframes : deltas).add(size);
+                sizes[i] = size;
+                full_state += full_state_size(snapshot);
+                max_entities = std::max<int>(
+                    max_entities, snapshot.foes.size() + snapshot.missiles.size() + snapshot.explosions.size());
+            }
+
+            // one world per datagram if both together don't fit, like MatchWorker does
+            if (DatagramHeaderSize + sizes[0] + sizes[1] <= MaxPacketSize)
+            {
+                datagrams.add(DatagramHeaderSize + sizes[0] + sizes[1]);
+            }
+            else
+            {
+                datagrams.add(DatagramHeaderSize + sizes[0]);
+                datagrams.add(DatagramHeaderSize + sizes[1]);
+            }
+            full_states.add(full_state);
+        }
+
+        std::cout << tics << " tics of 2 worlds, keyframe every " << keyframe_interval << " tics, up to "
+                  << max_entities << " entities per world\n";
+        std::cout << "keyframes: " << keyframes.mean() << " bytes on average, " << keyframes.max << " at most\n";
+        std::cout << "deltas: " << deltas.mean() << " bytes on average, " << deltas.max << " at most\n";
+        std::cout << "largest datagram: " << datagrams.max << " bytes\n";
+        if (datagrams.max > MaxPacketSize)
+            panic("a snapshot doesn't fit in a datagram, the match server would drop it\n");
+
+        const auto payload = static_cast<double>(keyframes.total + deltas.total) / seconds;
+        const auto datagram = static_cast<double>(datagrams.total) / seconds;
+        const auto wire = datagram + static_cast<double>(UdpIpHeaderSize) * datagrams.count / seconds;
+        const auto full = static_cast<double>(full_states.total) / seconds;
+        std::cout << "per spectator: " << payload << " bytes/s of snapshots, " << datagram << " bytes/s of datagrams, "
+                  << wire << " bytes/s with UDP/IPv4 headers\n";
+        std::cout << "full state every tic: " << full << " bytes/s, " << full / payload << "x the snapshots\n";
+    }
+
+    release_tilesheets();
+}
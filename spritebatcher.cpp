@@ -1,13 +1,76 @@
 #include "spritebatcher.h"
 
 #include "texture.h"
+#include "renderstate.h"
 
 #include <glm/gtc/matrix_transform.hpp>
 
 #include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstddef>
 #include <iostream>
+#include <thread>
+
+namespace
+{
+// LSD radix sort on 8-bit digits. The lowest sorted_bits of the keys must already be in ascending order,
+// so no passes are spent on them; passes on a digit that is the same for every key are skipped too.
+template<typename KeyT>
+void radix_sort(std::vector<KeyT> &keys, std::vector<KeyT> &scratch, int sorted_bits)
+{
+    constexpr int DigitBits = 8;
+    constexpr int NumDigits = 8 * sizeof(KeyT) / DigitBits;
+    constexpr int NumBuckets = 1 << DigitBits;
+
+    const int first_digit = sorted_bits / DigitBits;
+
+    std::array<std::array<std::size_t, NumBuckets>, NumDigits> counts = {};
+    for (const auto key : keys)
+    {
+        for (int digit = first_digit; digit < NumDigits; ++digit)
+            ++counts[digit][(key >> (digit * DigitBits)) & (NumBuckets - 1)];
+    }
+
+    scratch.resize(keys.size());
+
+    for (int digit = first_digit; digit < NumDigits; ++digit)
+    {
+        const auto shift = digit * DigitBits;
+        auto &digit_counts = counts[digit];
+
+        if (keys.empty() || digit_counts[(keys.front() >> shift) & (NumBuckets - 1)] == keys.size())
+            continue;
+
+        std::size_t offset = 0;
+        for (auto &count : digit_counts)
+        {
+            const auto bucket_size = count;
+            count = offset;
+            offset += bucket_size;
+        }
+
+        for (const auto key : keys)
+            scratch[digit_counts[(key >> shift) & (NumBuckets - 1)]++] = key;
+
+        keys.swap(scratch);
+    }
+}
+}
+
+namespace
+{
+int worker_thread_count()
+{
+    constexpr auto MaxWorkerThreads = 7;
+    const auto hardware_threads = static_cast<int>(std::thread::hardware_concurrency());
+    return std::clamp(hardware_threads - 1, 0, MaxWorkerThreads);
+}
+}
 
 SpriteBatcher::SpriteBatcher()
+    : workers_(worker_thread_count())
+    , instance_buffer_(GL_ARRAY_BUFFER, (sizeof(Instance) * MaxQuadsPerChunk + ViewportBlockSize) * ChunksInFlight)
 {
     initialize_gl_resources();
 }
@@ -17,104 +80,158 @@ SpriteBatcher::~SpriteBatcher()
     release_gl_resources();
 }
 
-void SpriteBatcher::set_transform_matrix(const glm::mat4 &matrix)
+void SpriteBatcher::set_viewport(int index, const glm::mat4 &transform, const glm::vec4 &clip_rect)
 {
-    transform_matrix_ = matrix;
+    assert(index >= 0 && index < MaxViewports);
+    viewports_[index] = {transform, clip_rect};
+    viewport_count_ = std::max(viewport_count_, index + 1);
+}
+
+void SpriteBatcher::set_current_viewport(int index)
+{
+    assert(index >= 0 && index < viewport_count_);
+    cur_viewport_ = index;
 }
 
 glm::mat4 SpriteBatcher::transform_matrix() const
 {
-    return transform_matrix_;
+    return viewports_[cur_viewport_].transform;
 }
 
 void SpriteBatcher::start_batch()
 {
+    if (tile_generation_ != get_tiles_generation())
+        update_tile_buffer();
+
     quads_.clear();
+    sort_keys_.clear();
+
+    const auto frame = stats_.frame;
+    stats_ = RenderStats{};
+    stats_.frame = frame + 1;
+    stats_.viewport_quads.resize(MaxViewports);
 }
 
-void SpriteBatcher::add_sprite(const Tile *tile, const QuadVerts &verts, int depth)
+void SpriteBatcher::add_sprite(const Tile *tile, const glm::vec2 &position, const glm::vec2 &scale, int depth)
 {
-    quads_.emplace_back(tile, verts, glm::vec4(0.0f), depth);
+    add_sprite(tile, position, scale, 0.0f, glm::vec4(0.0f), depth);
 }
 
-void SpriteBatcher::add_sprite(const Tile *tile, const QuadVerts &verts, const glm::vec4 &flat_color, int depth)
+void SpriteBatcher::add_sprite(const Tile *tile, const glm::vec2 &position, const glm::vec2 &scale, float rotation,
+                               const glm::vec4 &flat_color, int depth)
 {
-    quads_.emplace_back(tile, verts, flat_color, depth);
+    assert(quads_.size() < (SortKey(1) << OrderBits));
+    assert(tile->texture_index < (1 << TextureBits));
+
+    constexpr auto MinDepth = -(1 << (DepthBits - 1));
+    constexpr auto MaxDepth = (1 << (DepthBits - 1)) - 1;
+    const auto depth_bits = static_cast<SortKey>(std::clamp(depth, MinDepth, MaxDepth) - MinDepth);
+
+    const auto key = (depth_bits << (TextureBits + OrderBits)) |
+                     (static_cast<SortKey>(tile->texture_index) << OrderBits) |
+                     static_cast<SortKey>(quads_.size());
+    sort_keys_.push_back(key);
+
+    assert(tile->index < (1 << (32 - ViewportBits)));
+
+    const auto half_size = 0.5f * scale * glm::vec2(tile->size);
+    const auto axis = rotation != 0.0f ? glm::vec2(std::cos(rotation), std::sin(rotation)) : glm::vec2(1.0f, 0.0f);
+    const auto tile_and_viewport = static_cast<GLuint>(tile->index) | (static_cast<GLuint>(cur_viewport_) << (32 - ViewportBits));
+    const auto packed_color = glm::packUnorm<glm::uint8>(glm::clamp(flat_color, 0.0f, 1.0f));
+    quads_.push_back({tile, {position, half_size, axis, tile_and_viewport, packed_color}});
+
+    ++stats_.viewport_quads[cur_viewport_];
 }
 
-void SpriteBatcher::render_batch() const
+void SpriteBatcher::render_batch()
 {
-    std::vector<const Quad *> sorted_quads;
-    sorted_quads.resize(quads_.size());
-    std::transform(quads_.begin(), quads_.end(), sorted_quads.begin(), [](const Quad &quad) {
-        return &quad;
-    });
-    std::stable_sort(sorted_quads.begin(), sorted_quads.end(), [](const Quad *a, const Quad *b) {
-        return std::tie(a->depth, a->tile->texture) < std::tie(b->depth, b->tile->texture);
-    });
+    gpu_timer_.begin();
 
-    glBindBuffer(GL_ARRAY_BUFFER, vbo_);
-    auto *data_start = reinterpret_cast<GLfloat *>(glMapBuffer(GL_ARRAY_BUFFER, GL_WRITE_ONLY));
+    // keys are generated in submission order, so the order bits are already sorted
+    radix_sort(sort_keys_, sort_scratch_, OrderBits);
 
-    glBindVertexArray(vao_); // XXX do we need to bind the buffer after doing this?
+    bind_vertex_array(vao_);
+    bind_buffer_base(GL_SHADER_STORAGE_BUFFER, 0, tile_buffer_);
 
     program_.bind();
-    program_.set_uniform(program_.uniform_location("mvp"), transform_matrix_);
-    program_.set_uniform(program_.uniform_location("sprite_texture"), 0);
 
-    const Texture *cur_texture = nullptr;
-    auto *data = data_start;
+    constexpr auto NumClipPlanes = 4;
+    for (int i = 0; i < NumClipPlanes; ++i)
+        glEnable(GL_CLIP_DISTANCE0 + i);
 
-    int draw_calls = 0;
-    const auto do_render = [&cur_texture, &data_start, &data, &draw_calls] {
-        const auto vertex_count = (data - data_start) / 8;
-        if (vertex_count)
-        {
-            cur_texture->bind();
-            glDrawArrays(GL_TRIANGLES, 0, vertex_count);
-            ++draw_calls;
-        }
+    const auto order_of = [](SortKey key) {
+        return key & ((SortKey(1) << OrderBits) - 1);
+    };
+    const auto texture_of = [](SortKey key) {
+        return (key >> OrderBits) & ((SortKey(1) << TextureBits) - 1);
     };
 
-    for (const auto *quad_ptr : sorted_quads)
+    auto bound_texture = ~SortKey(0);
+
+    // batches larger than a chunk are split so that the ring always has room for the next one
+    for (std::size_t chunk_start = 0; chunk_start < sort_keys_.size(); chunk_start += MaxQuadsPerChunk)
     {
-        const auto vertex_count = data - data_start;
-        if (quad_ptr->tile->texture != cur_texture)
+        const auto *chunk_keys = sort_keys_.data() + chunk_start;
+        const auto chunk_quads = std::min<std::size_t>(sort_keys_.size() - chunk_start, MaxQuadsPerChunk);
+
+        // viewport transforms and clip rectangles go through the ring as well, ahead of each chunk's instances
+        // and fenced along with them, so a later chunk wrapping around can't overwrite them while still in use
+        const auto viewports_size = sizeof(viewports_);
+        const auto viewports_range = instance_buffer_.allocate(viewports_size, uniform_buffer_alignment_);
+        std::copy(viewports_.begin(), viewports_.end(), reinterpret_cast<GLViewport *>(viewports_range.data));
+        stats_.bytes_uploaded += viewports_size;
+        bind_buffer_range(GL_UNIFORM_BUFFER, 0, instance_buffer_.id(), viewports_range.offset, viewports_size);
+
+        const auto range = instance_buffer_.allocate(chunk_quads * sizeof(Instance), sizeof(Instance));
+        auto *data = reinterpret_cast<Instance *>(range.data);
+        stats_.bytes_uploaded += range.size;
+
+        // every instance has a fixed slot, so the workers can fill disjoint parts of the chunk while this thread
+        // waits to issue the draws
+        const auto fill = [this, data, chunk_keys, &order_of](std::size_t begin, std::size_t end) {
+            for (auto i = begin; i < end; ++i)
+                data[i] = quads_[order_of(chunk_keys[i])].instance;
+        };
+        const int workers = chunk_quads / MinQuadsPerWorker;
+        if (workers >= 2)
+            workers_.parallel_for(chunk_quads, workers, fill);
+        else
+            fill(0, chunk_quads);
+
+        // one draw call per run of quads sharing a texture
+        const GLuint first_instance = range.offset / sizeof(Instance);
+        std::size_t run_start = 0;
+        while (run_start < chunk_quads)
         {
-            if (data != data_start)
+            const auto texture = texture_of(chunk_keys[run_start]);
+            auto run_end = run_start + 1;
+            while (run_end < chunk_quads && texture_of(chunk_keys[run_end]) == texture)
+                ++run_end;
+
+            if (texture != bound_texture)
             {
-                glUnmapBuffer(GL_ARRAY_BUFFER);
-                do_render();
-                data_start = reinterpret_cast<GLfloat *>(glMapBuffer(GL_ARRAY_BUFFER, GL_WRITE_ONLY));
+                quads_[order_of(chunk_keys[run_start])].tile->texture->bind();
+                bound_texture = texture;
+                ++stats_.texture_switches;
             }
-            cur_texture = quad_ptr->tile->texture;
-            data = data_start;
-        }
+            glDrawArraysInstancedBaseInstance(GL_TRIANGLE_STRIP, 0, 4, run_end - run_start, first_instance + run_start);
+            ++stats_.draw_calls;
 
-        const auto &verts = quad_ptr->verts;
-        const auto &tex_coords = quad_ptr->tile->tex_coords;
-        const auto &flat_color = quad_ptr->flat_color;
-
-        const auto emit_vertex = [&data, &verts, &tex_coords, &flat_color](int index) {
-            *data++ = verts[index].x;
-            *data++ = verts[index].y;
-            *data++ = tex_coords[index].x;
-            *data++ = tex_coords[index].y;
-            *data++ = flat_color.r;
-            *data++ = flat_color.g;
-            *data++ = flat_color.b;
-            *data++ = flat_color.a;
-        };
+            run_start = run_end;
+        }
 
-        emit_vertex(0); emit_vertex(1); emit_vertex(2);
-        emit_vertex(2); emit_vertex(3); emit_vertex(0);
+        instance_buffer_.lock(viewports_range);
+        instance_buffer_.lock(range);
     }
 
-    glUnmapBuffer(GL_ARRAY_BUFFER);
-    do_render();
+    for (int i = 0; i < NumClipPlanes; ++i)
+        glDisable(GL_CLIP_DISTANCE0 + i);
+
+    gpu_timer_.end();
 
-    glBindVertexArray(0);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    stats_.quads = quads_.size();
+    stats_.viewport_quads.resize(viewport_count_);
+    stats_.gpu_milliseconds = gpu_timer_.milliseconds();
 }
 
 void SpriteBatcher::initialize_gl_resources()
@@ -123,29 +240,59 @@ void SpriteBatcher::initialize_gl_resources()
     program_.add_shader(GL_FRAGMENT_SHADER, "resources/shaders/sprite.frag");
     program_.link();
 
-    glGenBuffers(1, &vbo_);
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &uniform_buffer_alignment_);
+
+    glGenBuffers(1, &tile_buffer_);
+    update_tile_buffer();
+
+    // unit quad as a triangle strip
+    static const GLfloat quad_verts[] = {-1, -1, -1, 1, 1, -1, 1, 1};
+
+    glGenBuffers(1, &quad_vbo_);
     glGenVertexArrays(1, &vao_);
 
-    glBindBuffer(GL_ARRAY_BUFFER, vbo_);
-    glBufferData(GL_ARRAY_BUFFER, GLVertexSize * MaxQuadsPerBatch * 6, nullptr, GL_STATIC_DRAW);
+    bind_vertex_array(vao_);
 
-    glBindVertexArray(vao_);
+    bind_buffer(GL_ARRAY_BUFFER, quad_vbo_);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(quad_verts), quad_verts, GL_STATIC_DRAW);
 
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, GLVertexSize, reinterpret_cast<GLvoid *>(0));
+    detail::declare_vertex_attrib_pointer<glm::vec2>(0, sizeof(glm::vec2), 0);
 
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, GLVertexSize, reinterpret_cast<GLvoid *>(2 * sizeof(GLfloat)));
+    bind_buffer(GL_ARRAY_BUFFER, instance_buffer_.id());
 
-    glEnableVertexAttribArray(2);
-    glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, GLVertexSize, reinterpret_cast<GLvoid *>(4 * sizeof(GLfloat)));
+    constexpr auto Stride = sizeof(Instance);
+    detail::declare_vertex_attrib_pointer<glm::vec2>(1, Stride, offsetof(Instance, position));
+    detail::declare_vertex_attrib_pointer<hvec2>(2, Stride, offsetof(Instance, half_size));
+    detail::declare_vertex_attrib_pointer<hvec2>(3, Stride, offsetof(Instance, axis));
+    detail::declare_vertex_attrib_pointer<GLuint>(4, Stride, offsetof(Instance, tile_and_viewport));
+    detail::declare_vertex_attrib_pointer<glm::u8vec4>(5, Stride, offsetof(Instance, flat_color));
 
-    glBindVertexArray(0);
+    for (GLuint index = 1; index <= 5; ++index)
+        glVertexAttribDivisor(index, 1);
+}
+
+// texture rectangle and array layer of every tile, indexed by Tile::index
+void SpriteBatcher::update_tile_buffer()
+{
+    const auto &tiles = get_tiles();
+    std::vector<GLTile> gl_tiles;
+    gl_tiles.reserve(tiles.size());
+    std::transform(tiles.begin(), tiles.end(), std::back_inserter(gl_tiles), [](const Tile *tile) {
+        const auto &tex_coords = tile->tex_coords;
+        return GLTile{glm::vec4(tex_coords[0], tex_coords[2] - tex_coords[0]), static_cast<GLuint>(tile->layer), {}};
+    });
+
+    bind_buffer(GL_SHADER_STORAGE_BUFFER, tile_buffer_);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, gl_tiles.size() * sizeof(GLTile), gl_tiles.data(), GL_STATIC_DRAW);
+    tile_generation_ = get_tiles_generation();
 }
 
 void SpriteBatcher::release_gl_resources()
 {
-    glDeleteBuffers(1, &vbo_);
+    buffer_deleted(quad_vbo_);
+    buffer_deleted(tile_buffer_);
+    vertex_array_deleted(vao_);
+    glDeleteBuffers(1, &quad_vbo_);
+    glDeleteBuffers(1, &tile_buffer_);
     glDeleteVertexArrays(1, &vao_);
 }
-
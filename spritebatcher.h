@@ -1,6 +1,10 @@
 #pragma once
 
 #include "shaderprogram.h"
+#include "ringbuffer.h"
+#include "workerpool.h"
+#include "geometry.h"
+#include "renderstats.h"
 
 #include "tilesheet.h"
 
@@ -10,6 +14,7 @@
 #include <boost/noncopyable.hpp>
 
 #include <array>
+#include <cstdint>
 #include <vector>
 #include <memory>
 
@@ -19,39 +24,89 @@ public:
     SpriteBatcher();
     ~SpriteBatcher();
 
-    void set_transform_matrix(const glm::mat4 &matrix);
-    glm::mat4 transform_matrix() const;
+    static constexpr const int MaxViewports = 8;
+
+    // Sprites are clipped to clip_rect (x0, y0, x1, y1), in the coordinate space before transform.
+    void set_viewport(int index, const glm::mat4 &transform, const glm::vec4 &clip_rect);
+    void set_current_viewport(int index); // viewport of the sprites added from now on
+    glm::mat4 transform_matrix() const; // of the current viewport
 
     void start_batch();
-    void add_sprite(const Tile *tile, const QuadVerts &verts, int depth);
-    void add_sprite(const Tile *tile, const QuadVerts &verts, const glm::vec4 &flat_color, int depth);
-    void render_batch() const;
+    void add_sprite(const Tile *tile, const glm::vec2 &position, const glm::vec2 &scale, int depth);
+    void add_sprite(const Tile *tile, const glm::vec2 &position, const glm::vec2 &scale, float rotation,
+                    const glm::vec4 &flat_color, int depth);
+    void render_batch();
+
+    const RenderStats &stats() const { return stats_; } // of the last render_batch
 
 private:
     void initialize_gl_resources();
     void release_gl_resources();
+    void update_tile_buffer();
+
+    // per-instance vertex data, expanded into a quad by sprite.vert
+    struct Instance
+    {
+        glm::vec2 position;
+        hvec2 half_size;
+        hvec2 axis; // cos and sin of the rotation
+        GLuint tile_and_viewport; // viewport index in the top ViewportBits
+        glm::u8vec4 flat_color;
+    };
+    static_assert(sizeof(Instance) == 24);
+
+    static constexpr const int ViewportBits = 8;
+    static_assert(MaxViewports <= (1 << ViewportBits));
+
+    // matches Viewport in sprite.vert (std140)
+    struct GLViewport
+    {
+        glm::mat4 transform;
+        glm::vec4 clip_rect;
+    };
 
     struct Quad
     {
         const Tile *tile;
-        QuadVerts verts;
-        glm::vec4 flat_color;
-        int depth;
-
-        Quad(const Tile *tile, const QuadVerts &verts, const glm::vec4 &flat_color, int depth)
-            : tile(tile)
-            , verts(verts)
-            , flat_color(flat_color)
-            , depth(depth)
-        { }
+        Instance instance;
+    };
+
+    // tile table entry, matches TileInfo in sprite.vert (std430)
+    struct GLTile
+    {
+        glm::vec4 rect;
+        GLuint layer;
+        GLuint padding[3];
     };
+    static_assert(sizeof(GLTile) == 8 * sizeof(GLfloat));
+
+    // Sort keys, from most to least significant: depth, texture, submission order. The submission order
+    // is also the quad's index in quads_.
+    using SortKey = uint64_t;
+    static constexpr const int DepthBits = 16;
+    static constexpr const int TextureBits = 24;
+    static constexpr const int OrderBits = 24;
+    static_assert(DepthBits + TextureBits + OrderBits == 8 * sizeof(SortKey));
 
-    static constexpr const int GLVertexSize = (2 + 2 + 4) * sizeof(GLfloat);
-    static constexpr const int MaxQuadsPerBatch = 1024;
+    static constexpr const int MaxQuadsPerChunk = 16384;
+    static constexpr const int ChunksInFlight = 3;
+    static constexpr const int MinQuadsPerWorker = 2048; // per share; chunks too small for two are filled on the GL thread
+    static constexpr const std::size_t ViewportBlockSize = MaxViewports * sizeof(GLViewport) + 256; // plus UBO alignment
 
     std::vector<Quad> quads_;
+    std::vector<SortKey> sort_keys_;
+    std::vector<SortKey> sort_scratch_;
+    WorkerPool workers_;
     GLuint vao_;
-    GLuint vbo_;
+    GLuint quad_vbo_;
+    GLuint tile_buffer_;
+    int tile_generation_ = -1; // of the tiles in tile_buffer_, to catch sheets cached later
+    RingBuffer instance_buffer_;
     ShaderProgram program_;
-    glm::mat4 transform_matrix_;
+    std::array<GLViewport, MaxViewports> viewports_;
+    int viewport_count_ = 0;
+    int cur_viewport_ = 0;
+    GLint uniform_buffer_alignment_;
+    RenderStats stats_;
+    GpuTimer gpu_timer_;
 };
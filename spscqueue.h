@@ -0,0 +1,149 @@
+#pragma once
+
+#include <boost/noncopyable.hpp>
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <thread>
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// Bounded lock-free single producer, single consumer queue. Head and tail live on their own cache lines, and
+// each side keeps a cached copy of the other side's index so it only touches the shared one when it looks
+// full (or empty). Polling with try_pop() or drain() never makes a syscall. A consumer that would rather
+// sleep can wait(); the producer then pays for a futex wake, but only while someone is actually waiting.
+template<typename T>
+class SpscQueue : private boost::noncopyable
+{
+public:
+    explicit SpscQueue(std::size_t capacity)
+        : capacity_(round_up_to_power_of_two(capacity))
+        , mask_(capacity_ - 1)
+        , slots_(new T[capacity_])
+    {
+    }
+
+    // producer side
+    bool try_push(const T &value)
+    {
+        const auto tail = tail_.load(std::memory_order_relaxed);
+        if (tail - cached_head_ == capacity_)
+        {
+            cached_head_ = head_.load(std::memory_order_acquire);
+            if (tail - cached_head_ == capacity_)
+                return false;
+        }
+
+        slots_[tail & mask_] = value;
+        tail_.store(tail + 1, std::memory_order_release);
+
+        wake_consumer();
+        return true;
+    }
+
+    // producer side, yields while full
+    void push(const T &value)
+    {
+        while (!try_push(value))
+            std::this_thread::yield();
+    }
+
+    // consumer side
+    bool try_pop(T &value)
+    {
+        const auto head = head_.load(std::memory_order_relaxed);
+        if (head == cached_tail_)
+        {
+            cached_tail_ = tail_.load(std::memory_order_acquire);
+            if (head == cached_tail_)
+                return false;
+        }
+
+        value = slots_[head & mask_];
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // consumer side, hands everything queued right now to f and releases the slots in one go
+    template<typename F>
+    std::size_t drain(F &&f)
+    {
+        const auto head = head_.load(std::memory_order_relaxed);
+        cached_tail_ = tail_.load(std::memory_order_acquire);
+
+        for (auto i = head; i != cached_tail_; ++i)
+            f(slots_[i & mask_]);
+
+        head_.store(cached_tail_, std::memory_order_release);
+        return cached_tail_ - head;
+    }
+
+    // consumer side, blocks until there's something to pop
+    void wait()
+    {
+        while (empty())
+        {
+            waiting_.store(1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (!empty())
+                break;
+#ifdef __linux__
+            syscall(SYS_futex, reinterpret_cast<uint32_t *>(&waiting_), FUTEX_WAIT_PRIVATE, 1, nullptr, nullptr, 0);
+#else
+            std::this_thread::yield();
+#endif
+        }
+        waiting_.store(0, std::memory_order_relaxed);
+    }
+
+    bool empty() const { return head_.load(std::memory_order_relaxed) == tail_.load(std::memory_order_acquire); }
+
+    // exact only on the consumer side, a snapshot anywhere else
+    std::size_t size() const { return tail_.load(std::memory_order_acquire) - head_.load(std::memory_order_acquire); }
+
+    std::size_t capacity() const { return capacity_; }
+
+private:
+    static constexpr std::size_t CacheLineSize = 64;
+
+    static std::size_t round_up_to_power_of_two(std::size_t n)
+    {
+        assert(n > 0);
+        std::size_t result = 1;
+        while (result < n)
+            result <<= 1;
+        return result;
+    }
+
+    void wake_consumer()
+    {
+        // pairs with the fence in wait(): either the consumer sees the new tail, or we see it waiting
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (waiting_.load(std::memory_order_relaxed))
+        {
+            waiting_.store(0, std::memory_order_relaxed);
+#ifdef __linux__
+            syscall(SYS_futex, reinterpret_cast<uint32_t *>(&waiting_), FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+#endif
+        }
+    }
+
+    const std::size_t capacity_;
+    const std::size_t mask_;
+    const std::unique_ptr<T[]> slots_;
+
+    alignas(CacheLineSize) std::atomic<std::size_t> head_{0}; // written by the consumer
+    std::size_t cached_tail_ = 0;
+
+    alignas(CacheLineSize) std::atomic<std::size_t> tail_{0}; // written by the producer
+    std::size_t cached_head_ = 0;
+
+    alignas(CacheLineSize) std::atomic<uint32_t> waiting_{0}; // futex word, 1 while the consumer sleeps
+};
@@ -1,40 +1,75 @@
 #include "texture.h"
 
 #include "pixmap.h"
+#include "renderstate.h"
+
+#include <cassert>
 
 Texture::Texture(const char *path)
-    : pixmap_(load_pixmap_from_png(path))
+    : target_(GL_TEXTURE_2D)
+    , pixmap_(load_pixmap_from_png(path))
 {
     glGenTextures(1, &id_);
     set_data(*pixmap_);
 }
 
+Texture::Texture(const std::vector<const Pixmap *> &layers)
+    : target_(GL_TEXTURE_2D_ARRAY)
+{
+    glGenTextures(1, &id_);
+    set_data(layers);
+}
+
 Texture::~Texture()
 {
+    texture_deleted(id_);
     glDeleteTextures(1, &id_);
 }
 
 void Texture::bind() const
 {
-    glBindTexture(GL_TEXTURE_2D, id_);
+    bind_texture(target_, id_);
+}
+
+void Texture::unbind() const
+{
+    bind_texture(target_, 0);
 }
 
-void Texture::unbind()
+void Texture::set_parameters()
 {
-    glBindTexture(GL_TEXTURE_2D, 0);
+    glTexParameteri(target_, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(target_, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(target_, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(target_, GL_TEXTURE_WRAP_T, GL_REPEAT);
 }
 
 void Texture::set_data(const Pixmap &pm)
 {
     bind();
 
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    set_parameters();
     glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, pm.width, pm.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, pm.pixels.data());
+}
+
+void Texture::set_data(const std::vector<const Pixmap *> &layers)
+{
+    assert(!layers.empty());
+
+    const auto width = layers.front()->width;
+    const auto height = layers.front()->height;
+
+    bind();
 
-    unbind();
+    set_parameters();
+    glTexStorage3D(GL_TEXTURE_2D_ARRAY, 1, GL_RGBA8, width, height, layers.size());
+    for (std::size_t i = 0; i < layers.size(); ++i)
+    {
+        const auto *pm = layers[i];
+        assert(pm->width == width && pm->height == height);
+        assert(pm->type == Pixmap::PixelType::RGBAlpha);
+        glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, i, width, height, 1, GL_RGBA, GL_UNSIGNED_BYTE, pm->pixels.data());
+    }
 }
 
 const Pixmap *Texture::pixmap() const
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <memory>
+#include <vector>
 
 #include <GL/glew.h>
 
@@ -12,16 +13,20 @@ class Texture : private boost::noncopyable
 {
 public:
     Texture(const char *path);
+    Texture(const std::vector<const Pixmap *> &layers); // 2D array, all layers must have the same size
     ~Texture();
 
     void bind() const;
-    static void unbind();
+    void unbind() const;
 
-    const Pixmap *pixmap() const;
+    const Pixmap *pixmap() const; // null for array textures
 
 private:
     void set_data(const Pixmap &pixmap);
+    void set_data(const std::vector<const Pixmap *> &layers);
+    void set_parameters();
 
+    GLenum target_;
     GLuint id_;
     std::unique_ptr<Pixmap> pixmap_;
 };
@@ -1,6 +1,8 @@
 #include "tilesheet.h"
 
+#ifndef HEADLESS
 #include "texture.h"
+#endif
 #include "pixmap.h"
 #include "fileutil.h"
 
@@ -8,13 +10,14 @@
 
 #include <algorithm>
 #include <cassert>
+#include <tuple>
 #include <unordered_map>
 
 namespace
 {
 struct TileSheet
 {
-    std::vector<std::unique_ptr<Texture>> textures;
+    std::vector<std::unique_ptr<Pixmap>> pages;
     std::vector<std::unique_ptr<Tile>> tiles;
 };
 
@@ -26,18 +29,18 @@ glm::ivec2 parse_ivec2(const rapidjson::Value &value)
     return {array[0].GetInt(), array[1].GetInt()};
 }
 
-std::unique_ptr<Tile> parse_tile(const rapidjson::Value &value, const std::vector<std::unique_ptr<Texture>> &textures)
+std::unique_ptr<Tile> parse_tile(const rapidjson::Value &value, const std::vector<std::unique_ptr<Pixmap>> &pages)
 {
     auto tile = std::make_unique<Tile>();
     tile->name = value["name"].GetString();
     tile->position = parse_ivec2(value["position"]);
     tile->size = parse_ivec2(value["size"]);
 
-    const auto texture_index = value["texture"].GetInt();
-    assert(texture_index >= 0 && texture_index < textures.size());
-    tile->texture = textures[texture_index].get();
+    const auto page_index = value["texture"].GetInt();
+    assert(page_index >= 0 && page_index < pages.size());
+    tile->pixmap = pages[page_index].get();
 
-    const auto *pm = tile->texture->pixmap();
+    const auto *pm = tile->pixmap;
 
     const auto texture_width = pm->width;
     const auto texture_height = pm->height;
@@ -69,22 +72,36 @@ std::unique_ptr<TileSheet> load_tilesheet(const std::string &filename)
     const auto textures = document["textures"].GetArray();
     for (const auto &texture_path : textures)
     {
-        sheet->textures.emplace_back(new Texture(texture_path.GetString()));
+        sheet->pages.push_back(load_pixmap_from_png(texture_path.GetString()));
     }
 
     const auto tiles = document["sprites"].GetArray();
     for (const auto &value : tiles)
     {
-        sheet->tiles.push_back(parse_tile(value, sheet->textures));
+        sheet->tiles.push_back(parse_tile(value, sheet->pages));
     }
 
     return sheet;
 }
 
+// all cached pages with the same size, uploaded as the layers of a single 2D array texture
+struct TextureArray
+{
+    std::size_t width;
+    std::size_t height;
+    std::vector<const Pixmap *> layers;
+#ifndef HEADLESS
+    std::unique_ptr<Texture> texture;
+#endif
+};
+
 struct TileMap
 {
     std::vector<std::unique_ptr<TileSheet>> sheets;
+    std::vector<TextureArray> texture_arrays;
     std::unordered_map<std::string, const Tile *> tiles;
+    std::vector<const Tile *> tile_list;
+    int generation = 0;
 
     void cache_sheet(const std::string &path);
     void release_sheets();
@@ -100,15 +117,67 @@ TileMap &get_tile_map()
 void TileMap::cache_sheet(const std::string &path)
 {
     auto sheet = load_tilesheet(path);
+
+    std::vector<bool> changed(texture_arrays.size(), false);
+    std::unordered_map<const Pixmap *, std::pair<int, int>> page_layers; // page -> (texture index, layer)
+
+    for (const auto &page : sheet->pages)
+    {
+        auto it = std::find_if(texture_arrays.begin(), texture_arrays.end(), [&page](const TextureArray &array) {
+            return array.width == page->width && array.height == page->height;
+        });
+        if (it == texture_arrays.end())
+        {
+            texture_arrays.push_back({page->width, page->height, {}});
+            changed.push_back(true);
+            it = std::prev(texture_arrays.end());
+        }
+
+        const auto texture_index = std::distance(texture_arrays.begin(), it);
+        changed[texture_index] = true;
+        page_layers[page.get()] = {texture_index, it->layers.size()};
+        it->layers.push_back(page.get());
+    }
+
+#ifndef HEADLESS
+    // arrays can't grow in place, so re-upload the ones that gained pages
+    for (std::size_t i = 0; i < texture_arrays.size(); ++i)
+    {
+        if (changed[i])
+            texture_arrays[i].texture = std::make_unique<Texture>(texture_arrays[i].layers);
+    }
+
+    for (const auto &cached_sheet : sheets)
+    {
+        for (const auto &tile : cached_sheet->tiles)
+            tile->texture = texture_arrays[tile->texture_index].texture.get();
+    }
+#endif
+
     for (const auto &tile : sheet->tiles)
+    {
+        std::tie(tile->texture_index, tile->layer) = page_layers[tile->pixmap];
+#ifndef HEADLESS
+        tile->texture = texture_arrays[tile->texture_index].texture.get();
+#else
+        tile->texture = nullptr; // pixmaps only, for collision masks
+#endif
+        tile->index = tile_list.size();
+        tile_list.push_back(tile.get());
         tiles[tile->name] = tile.get();
+    }
+
     sheets.push_back(std::move(sheet));
+    ++generation;
 }
 
 void TileMap::release_sheets()
 {
     sheets.clear();
+    texture_arrays.clear();
     tiles.clear();
+    tile_list.clear();
+    ++generation;
 }
 
 const Tile *TileMap::get_tile(const std::string &name) const
@@ -132,3 +201,13 @@ const Tile *get_tile(const std::string &name)
 {
     return get_tile_map().get_tile(name);
 }
+
+const std::vector<const Tile *> &get_tiles()
+{
+    return get_tile_map().tile_list;
+}
+
+int get_tiles_generation()
+{
+    return get_tile_map().generation;
+}
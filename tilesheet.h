@@ -9,6 +9,7 @@
 using QuadVerts = std::array<glm::vec2, 4>;
 
 class Texture;
+struct Pixmap;
 
 struct Tile
 {
@@ -16,10 +17,16 @@ struct Tile
     glm::ivec2 size;
     glm::ivec2 position;
     QuadVerts tex_coords;
-    const Texture *texture;
+    const Pixmap *pixmap; // sheet page containing the tile
+    const Texture *texture; // 2D array shared by every cached page with the same size
+    int texture_index; // of texture among the arrays, sprite batches are sorted and split by it
+    int layer; // layer of the page in texture
+    int index; // position in get_tiles()
 };
 
 void cache_tilesheet(const std::string &path);
 void release_tilesheets();
 
 const Tile *get_tile(const std::string &name);
+const std::vector<const Tile *> &get_tiles();
+int get_tiles_generation(); // changes whenever get_tiles() does
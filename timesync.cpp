@@ -0,0 +1,56 @@
+#include "timesync.h"
+
+#include "gameconstants.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+constexpr auto Smoothing = 0.25f; // of each new local advantage sample, reports are noisy by about a tic
+}
+
+TimeSync::TimeSync(const Settings &settings)
+    : settings_(settings)
+{
+}
+
+bool TimeSync::report(int tic, Report &report)
+{
+    if (tics_to_report_-- > 0)
+        return false;
+    tics_to_report_ = settings_.report_interval - 1;
+
+    report.tic = tic;
+    report.advantage = static_cast<int32_t>(std::lround(local_advantage_ * AdvantageScale));
+    return true;
+}
+
+void TimeSync::add_remote_report(int tic, const Report &report)
+{
+    // the other side has moved on by the time its report gets here
+    const auto one_way_tics = std::chrono::duration<float>(rtt_).count() * TicsPerSecond / 2;
+    const auto sample = tic - (static_cast<int>(report.tic) + one_way_tics);
+
+    if (have_remote_report_)
+        local_advantage_ += Smoothing * (sample - local_advantage_);
+    else
+        local_advantage_ = sample;
+    remote_advantage_ = static_cast<float>(report.advantage) / AdvantageScale;
+    have_remote_report_ = true;
+}
+
+float TimeSync::advantage() const
+{
+    if (!have_remote_report_)
+        return 0;
+    return 0.5f * (local_advantage_ - remote_advantage_);
+}
+
+float TimeSync::stretch() const
+{
+    const auto excess = advantage() - settings_.dead_zone;
+    if (excess <= 0)
+        return 0;
+    return std::min(settings_.gain * excess, settings_.max_stretch);
+}
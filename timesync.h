@@ -0,0 +1,57 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+
+// Keeps two peers' simulations in step. Each side runs tics on its own clock from whenever the connection
+// came up, so one of them ends up ahead, from drift or because the other one is slow; that side gets the
+// other's input late and keeps running into max_rollback. Every so often each side tells the other which tic
+// it's at and how far ahead of the other side it thinks it is. The one that's ahead by both estimates makes
+// its tics a little longer until the two are even again, instead of stalling.
+class TimeSync
+{
+public:
+    struct Settings
+    {
+        int report_interval = 15; // tics between reports
+        float dead_zone = 0.5f; // tics of advantage left alone
+        float gain = 0.04f; // tic stretch per tic of advantage past the dead zone
+        float max_stretch = 0.1f; // at most that much longer tics, 0 to turn it off
+    };
+
+    // what each side sends the other
+    struct Report
+    {
+        uint32_t tic; // the sender's
+        int32_t advantage; // the sender's local advantage, in 1/AdvantageScale tics
+    };
+
+    static constexpr int AdvantageScale = 256;
+
+    TimeSync(const Settings &settings);
+
+    void set_rtt(std::chrono::microseconds rtt) { rtt_ = rtt; }
+
+    // Has to be called once per tic, stalled or not. Returns the report to send, if it's time for one.
+    bool report(int tic, Report &report);
+
+    void add_remote_report(int tic, const Report &report);
+
+    // Tics we're ahead of the other side, negative if behind: half the difference between the two sides'
+    // estimates, so whatever the RTT estimate gets wrong cancels out as long as the link is symmetric.
+    float advantage() const;
+
+    // how much longer than usual the next tic should be, as a fraction of a tic
+    float stretch() const;
+
+    float local_advantage() const { return local_advantage_; }
+    float remote_advantage() const { return remote_advantage_; }
+
+private:
+    Settings settings_;
+    std::chrono::microseconds rtt_ = std::chrono::microseconds(0);
+    int tics_to_report_ = 0;
+    bool have_remote_report_ = false;
+    float local_advantage_ = 0; // tics ahead of where we think the other side is now, smoothed
+    float remote_advantage_ = 0; // the other side's local advantage, as of its last report
+};
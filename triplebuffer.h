@@ -0,0 +1,39 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+
+// Lock-free single producer, single consumer handoff of the latest value. The producer fills back() and
+// publishes it; the consumer picks up whatever was published last with update() and reads front(). Neither
+// side ever waits, intermediate values are simply dropped if the consumer is slower.
+template<typename T>
+class TripleBuffer
+{
+public:
+    T &back() { return buffers_[back_]; }
+
+    void publish()
+    {
+        back_ = present_.exchange(back_ | Fresh, std::memory_order_acq_rel) & IndexMask;
+    }
+
+    const T &front() const { return buffers_[front_]; }
+
+    // false if nothing was published since the last update, front() is unchanged then
+    bool update()
+    {
+        if (!(present_.load(std::memory_order_relaxed) & Fresh))
+            return false;
+        front_ = present_.exchange(front_, std::memory_order_acq_rel) & IndexMask;
+        return true;
+    }
+
+private:
+    static constexpr int IndexMask = 3;
+    static constexpr int Fresh = 4;
+
+    std::array<T, 3> buffers_;
+    int back_ = 0;
+    std::atomic<int> present_{1};
+    int front_ = 2;
+};
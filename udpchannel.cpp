@@ -0,0 +1,134 @@
+#include "udpchannel.h"
+
+#include "packet.h"
+
+#include <algorithm>
+#include <cassert>
+
+namespace
+{
+constexpr auto MaxInputWindow = 256; // tics per datagram, way beyond what the session lets build up
+constexpr auto MessageSize = 1 + 4 + 4;
+constexpr auto MaxMessages = 255; // per datagram, the count is a byte
+
+// true if a comes after b, allowing for wrap around
+bool sequence_after(uint16_t a, uint16_t b)
+{
+    return static_cast<int16_t>(a - b) > 0;
+}
+}
+
+UdpChannel::UdpChannel(uint32_t session_id)
+    : session_id_(session_id)
+{
+}
+
+void UdpChannel::queue_message(const Message &message)
+{
+    if (message.type == Message::Type::Input)
+    {
+        if (pending_inputs_.empty())
+            first_pending_tic_ = message.tic;
+        assert(message.tic == first_pending_tic_ + pending_inputs_.size());
+        pending_inputs_.push_back(message.value);
+        unsent_input_ = true;
+    }
+    else
+    {
+        pending_messages_.push_back(message);
+    }
+}
+
+void UdpChannel::write_data(PacketWriter &writer)
+{
+    writer.put_u8(static_cast<uint8_t>(PacketType::Data));
+    writer.put_u32(session_id_);
+    writer.put_u16(seq_++);
+    writer.put_u16(remote_seq_);
+    writer.put_u32(have_remote_tic_ ? next_remote_tic_ : 0);
+
+    // the oldest ones first, the other side can't use anything past a gap
+    const auto input_count = std::min<std::size_t>(pending_inputs_.size(), MaxInputWindow);
+    writer.put_inputs(first_pending_tic_,
+                      std::vector<uint8_t>(pending_inputs_.begin(), pending_inputs_.begin() + input_count));
+    unsent_input_ = input_count < pending_inputs_.size();
+
+    // as many as fit, the rest go with the next datagram
+    const auto room = (MaxPacketSize - writer.data().size() - 1) / MessageSize;
+    const auto message_count = std::min<std::size_t>({pending_messages_.size(), room, MaxMessages});
+    writer.put_u8(message_count);
+    for (std::size_t i = 0; i < message_count; ++i)
+    {
+        const auto &message = pending_messages_[i];
+        writer.put_u8(static_cast<uint8_t>(message.type));
+        writer.put_u32(message.tic);
+        writer.put_u32(message.value);
+    }
+    pending_messages_.erase(pending_messages_.begin(), pending_messages_.begin() + message_count);
+    assert(writer.data().size() <= MaxPacketSize);
+
+    last_send_time_ = Clock::now();
+}
+
+bool UdpChannel::read_data(PacketReader &reader, std::vector<Message> &messages)
+{
+    uint32_t session_id;
+    uint16_t seq, ack_seq;
+    uint32_t ack_tic;
+    if (!reader.get_u32(session_id) || session_id != session_id_)
+        return false;
+    if (!reader.get_u16(seq) || !reader.get_u16(ack_seq) || !reader.get_u32(ack_tic))
+        return false;
+
+    uint32_t first_tic;
+    std::vector<uint8_t> inputs;
+    if (!reader.get_inputs(first_tic, inputs))
+        return false;
+
+    std::vector<Message> other_messages;
+    uint8_t message_count;
+    if (!reader.get_u8(message_count))
+        return false;
+    for (int i = 0; i < message_count; ++i)
+    {
+        uint8_t type;
+        Message message;
+        if (!reader.get_u8(type) || !reader.get_u32(message.tic) || !reader.get_u32(message.value))
+            return false;
+        message.type = static_cast<Message::Type>(type);
+        other_messages.push_back(message);
+    }
+
+    touch();
+
+    if (sequence_after(seq, remote_seq_))
+        remote_seq_ = seq;
+
+    // acknowledged input doesn't need to be sent anymore
+    while (!pending_inputs_.empty() && first_pending_tic_ < ack_tic)
+    {
+        pending_inputs_.pop_front();
+        ++first_pending_tic_;
+    }
+
+    // nothing the other side sends is acknowledged before it gets here, so the first window starts at its first tic
+    if (!inputs.empty())
+    {
+        if (!have_remote_tic_)
+        {
+            next_remote_tic_ = first_tic;
+            have_remote_tic_ = true;
+        }
+
+        if (first_tic <= next_remote_tic_)
+        {
+            for (auto tic = next_remote_tic_; tic < first_tic + inputs.size(); ++tic)
+                messages.push_back({Message::Type::Input, tic, inputs[tic - first_tic]});
+            next_remote_tic_ = std::max<uint32_t>(next_remote_tic_, first_tic + inputs.size());
+        }
+    }
+
+    messages.insert(messages.end(), other_messages.begin(), other_messages.end());
+
+    return true;
+}
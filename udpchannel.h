@@ -0,0 +1,83 @@
+#pragma once
+
+#include "network.h"
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+class PacketWriter;
+class PacketReader;
+
+// The datagram protocol, shared by the game, the match server and its load generator.
+enum class PacketType : uint8_t
+{
+    Hello, // magic, version, session id, input delay, max rollback
+    Welcome, // magic, session id, port to send data to from now on, input delay, max rollback (0 for spectators)
+    Data, // session id, seq, ack seq, ack tic, inputs, messages
+    StatsRequest, // magic, match server only
+    StatsReply, // magic, worker count, then per worker: matches, tics, late tics, busy microseconds, desyncs
+    Spectate, // magic, version, session id, match id or 0 for the latest; answered with a Welcome, then resent
+              // to the worker every second to keep the stream coming
+    SpectatorData, // session id, seq, then for each of the match's two worlds a u16 size and a snapshot, which
+                   // is empty if the world didn't advance or went in a datagram of its own because both together
+                   // wouldn't fit in MaxPacketSize
+    Disconnect, // session id; from a match server's worker, the match is over
+};
+
+constexpr uint32_t ProtocolMagic = 0x5952505a; // "ZPRY"
+constexpr uint8_t ProtocolVersion = 5;
+constexpr auto MaxPacketSize = 1200;
+
+// One end of a connection past the handshake. Every Data datagram carries all the input the other side hasn't
+// acknowledged yet, run-length packed, so a lost datagram costs nothing as long as a later one gets through;
+// there's no retransmission and no head-of-line blocking. Other messages ride along once, unreliably, as many
+// per datagram as fit in MaxPacketSize.
+// Only builds and parses datagrams, sending them is up to the owner.
+class UdpChannel
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit UdpChannel(uint32_t session_id = 0);
+
+    uint32_t session_id() const { return session_id_; }
+    void set_session_id(uint32_t session_id) { session_id_ = session_id; }
+
+    // Input has to be queued in tic order, and stays queued until acknowledged.
+    void queue_message(const Message &message);
+
+    // a whole Data datagram with everything queued
+    void write_data(PacketWriter &writer);
+
+    // queued since the last write_data, or didn't fit in it
+    bool has_unsent() const { return unsent_input_ || !pending_messages_.empty(); }
+
+    // The rest of a Data datagram after the type. Appends what arrived to messages, input in tic order and
+    // only once; false if the datagram is malformed or for another session.
+    bool read_data(PacketReader &reader, std::vector<Message> &messages);
+
+    // counts as having heard from the other side now
+    void touch() { last_receive_time_ = Clock::now(); }
+
+    Clock::time_point last_send_time() const { return last_send_time_; }
+    Clock::time_point last_receive_time() const { return last_receive_time_; }
+
+private:
+    uint32_t session_id_;
+
+    // local input the other side hasn't acknowledged yet, starting at first_pending_tic_
+    std::deque<uint8_t> pending_inputs_;
+    uint32_t first_pending_tic_ = 0;
+    bool unsent_input_ = false;
+    std::vector<Message> pending_messages_; // sent once with the next datagram
+
+    bool have_remote_tic_ = false;
+    uint32_t next_remote_tic_ = 0; // everything before this was delivered
+
+    uint16_t seq_ = 0;
+    uint16_t remote_seq_ = 0; // latest received
+    Clock::time_point last_send_time_;
+    Clock::time_point last_receive_time_;
+};
@@ -0,0 +1,307 @@
+#include "udpnetwork.h"
+
+#include "packet.h"
+
+#include <algorithm>
+#include <cassert>
+#include <random>
+
+namespace
+{
+constexpr auto TimerInterval = std::chrono::milliseconds(5);
+constexpr auto ResendInterval = std::chrono::milliseconds(30); // if nothing new was sent in between
+constexpr auto HelloInterval = std::chrono::milliseconds(100);
+constexpr auto ConnectTimeout = std::chrono::seconds(5);
+constexpr auto IdleTimeout = std::chrono::seconds(3);
+}
+
+UdpNetworkThread::UdpNetworkThread(const boost::asio::ip::udp::endpoint &local_endpoint)
+    : socket_(io_context_, local_endpoint)
+    , timer_(io_context_)
+    , receive_buffer_(MaxPacketSize)
+{
+}
+
+// goes out with the next datagram, one per tic unless there's too much for one
+void UdpNetworkThread::send_message(const Message &message)
+{
+    channel_.queue_message(message);
+}
+
+void UdpNetworkThread::flush_messages()
+{
+    if (channel_.has_unsent())
+        send_data();
+}
+
+void UdpNetworkThread::set_link_conditions(const LinkConditions &conditions, unsigned seed)
+{
+    link_shim_ = std::make_unique<LinkShim>(socket_, conditions, seed);
+}
+
+void UdpNetworkThread::send_packet(const std::vector<uint8_t> &data)
+{
+    stats_.add_sent(data.size()); // including what the shim drops
+    if (link_shim_)
+    {
+        link_shim_->send_to(data, peer_endpoint_);
+    }
+    else
+    {
+        boost::system::error_code ignored_error;
+        socket_.send_to(boost::asio::buffer(data), peer_endpoint_, 0, ignored_error);
+    }
+}
+
+void UdpNetworkThread::set_connected()
+{
+    channel_.touch();
+    status_ = Status::Connected;
+}
+
+void UdpNetworkThread::send_handshake(PacketType type)
+{
+    PacketWriter writer;
+    writer.put_u8(static_cast<uint8_t>(type));
+    writer.put_u32(ProtocolMagic);
+    if (type == PacketType::Hello)
+        writer.put_u8(ProtocolVersion);
+    writer.put_u32(channel_.session_id());
+    if (type == PacketType::Welcome)
+        writer.put_u16(socket_.local_endpoint().port());
+    writer.put_u16(session_parameters_.input_delay);
+    writer.put_u16(session_parameters_.max_rollback);
+
+    send_packet(writer.data());
+}
+
+void UdpNetworkThread::send_data()
+{
+    if (status_ != Status::Connected)
+        return;
+
+    PacketWriter writer;
+    channel_.write_data(writer);
+    send_packet(writer.data());
+}
+
+void UdpNetworkThread::do_receive()
+{
+    socket_.async_receive_from(boost::asio::buffer(receive_buffer_), sender_endpoint_,
+        [this](boost::system::error_code ec, std::size_t bytes_transferred)
+        {
+            if (ec == boost::asio::error::operation_aborted)
+                return;
+
+            // other errors (e.g. ICMP port unreachable while the other side isn't up yet) only affect this
+            // datagram
+            if (!ec)
+                handle_packet(bytes_transferred);
+
+            do_receive();
+        });
+}
+
+void UdpNetworkThread::handle_packet(std::size_t size)
+{
+    stats_.add_received(size);
+
+    PacketReader reader(receive_buffer_.data(), size);
+
+    uint8_t type;
+    if (!reader.get_u8(type))
+        return;
+
+    switch (static_cast<PacketType>(type))
+    {
+        case PacketType::Hello:
+        case PacketType::Welcome:
+        {
+            uint32_t magic;
+            if (reader.get_u32(magic) && magic == ProtocolMagic)
+                handle_handshake(static_cast<PacketType>(type), reader);
+            break;
+        }
+
+        case PacketType::Data:
+            handle_data(reader);
+            break;
+
+        case PacketType::Disconnect:
+            handle_disconnect(reader);
+            break;
+
+        default:
+            break;
+    }
+}
+
+void UdpNetworkThread::handle_data(PacketReader &reader)
+{
+    if (status_ == Status::Disconnected || sender_endpoint_ != peer_endpoint_)
+        return;
+
+    received_messages_.clear();
+    if (!channel_.read_data(reader, received_messages_))
+        return;
+
+    // the Welcome got lost, but the other side is already talking to us
+    if (status_ == Status::Connecting)
+        set_connected();
+
+    for (const auto &message : received_messages_)
+        handle_message(message);
+}
+
+void UdpNetworkThread::handle_disconnect(PacketReader &reader)
+{
+    if (status_ != Status::Connected || sender_endpoint_ != peer_endpoint_)
+        return;
+
+    uint32_t session_id;
+    if (reader.get_u32(session_id) && session_id == channel_.session_id())
+        status_ = Status::Disconnected; // the timer closes the socket
+}
+
+void UdpNetworkThread::start_timer()
+{
+    timer_.expires_after(TimerInterval);
+    timer_.async_wait(
+        [this](boost::system::error_code ec)
+        {
+            if (!ec)
+                handle_timer();
+        });
+}
+
+void UdpNetworkThread::handle_timer()
+{
+    const auto now = Clock::now();
+
+    switch (status_)
+    {
+        case Status::Connecting:
+            update_connecting(now);
+            break;
+
+        case Status::Connected:
+            if (now - channel_.last_receive_time() > IdleTimeout)
+                status_ = Status::Disconnected;
+            else if (channel_.has_unsent() || now - channel_.last_send_time() > ResendInterval)
+                send_data(); // what wasn't flushed, or keeps acks flowing and resends input while stalled
+            break;
+
+        case Status::Disconnected:
+            break;
+    }
+
+    if (status_ == Status::Disconnected)
+    {
+        socket_.close();
+        return;
+    }
+
+    start_timer();
+}
+
+UdpServerNetworkThread::UdpServerNetworkThread(int port)
+    : UdpNetworkThread(boost::asio::ip::udp::endpoint(boost::asio::ip::udp::v4(), port))
+{
+}
+
+UdpServerNetworkThread::~UdpServerNetworkThread()
+{
+    stop();
+}
+
+void UdpServerNetworkThread::do_connect()
+{
+    do_receive();
+    start_timer();
+}
+
+void UdpServerNetworkThread::handle_handshake(PacketType type, PacketReader &reader)
+{
+    if (type != PacketType::Hello)
+        return;
+
+    uint8_t version;
+    uint32_t session_id;
+    SessionParameters parameters;
+    if (!reader.get_u8(version) || version != ProtocolVersion || !reader.get_u32(session_id) ||
+        !reader.get_u16(parameters.input_delay) || !reader.get_u16(parameters.max_rollback))
+        return;
+
+    if (status_ == Status::Connecting)
+    {
+        peer_endpoint_ = sender_endpoint_;
+        channel_.set_session_id(session_id);
+        if (check_session_parameters(parameters))
+            set_connected();
+    }
+
+    // the first Hello, or a repeat because the Welcome got lost; answered on a mismatch too, so that the client
+    // finds out
+    if (sender_endpoint_ == peer_endpoint_ && session_id == channel_.session_id())
+        send_handshake(PacketType::Welcome);
+}
+
+void UdpServerNetworkThread::update_connecting(Clock::time_point)
+{
+    // waits for a client indefinitely, like the TCP acceptor
+}
+
+UdpClientNetworkThread::UdpClientNetworkThread(std::string_view host, std::string_view service)
+    : UdpNetworkThread(boost::asio::ip::udp::endpoint(boost::asio::ip::udp::v4(), 0))
+{
+    boost::asio::ip::udp::resolver resolver(io_context_);
+    peer_endpoint_ = *resolver.resolve(boost::asio::ip::udp::v4(), host, service);
+
+    std::random_device rd;
+    channel_.set_session_id(rd());
+}
+
+UdpClientNetworkThread::~UdpClientNetworkThread()
+{
+    stop();
+}
+
+void UdpClientNetworkThread::do_connect()
+{
+    connect_time_ = last_hello_time_ = Clock::now();
+    send_handshake(PacketType::Hello);
+    do_receive();
+    start_timer();
+}
+
+void UdpClientNetworkThread::handle_handshake(PacketType type, PacketReader &reader)
+{
+    if (type != PacketType::Welcome || status_ != Status::Connecting || sender_endpoint_ != peer_endpoint_)
+        return;
+
+    uint32_t session_id;
+    uint16_t port;
+    SessionParameters parameters;
+    if (!reader.get_u32(session_id) || session_id != channel_.session_id() || !reader.get_u16(port) ||
+        !reader.get_u16(parameters.input_delay) || !reader.get_u16(parameters.max_rollback))
+        return;
+    if (!check_session_parameters(parameters))
+        return;
+
+    // a match server hands the session over to one of its workers
+    peer_endpoint_.port(port);
+    set_connected();
+}
+
+void UdpClientNetworkThread::update_connecting(Clock::time_point now)
+{
+    if (now - connect_time_ > ConnectTimeout)
+    {
+        status_ = Status::Disconnected;
+    }
+    else if (now - last_hello_time_ > HelloInterval)
+    {
+        send_handshake(PacketType::Hello);
+        last_hello_time_ = now;
+    }
+}
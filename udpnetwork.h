@@ -0,0 +1,88 @@
+#pragma once
+
+#include "network.h"
+#include "udpchannel.h"
+#include "linkshim.h"
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+class PacketReader;
+
+// Messages over UDP, through a UdpChannel.
+//
+// The client opens with a Hello carrying a random session id, resent until the server answers with a
+// Welcome; after that datagrams from anywhere else or with another session id are ignored. The Welcome
+// names the port to talk to from then on, which for the match server isn't the one the Hello went to. Both
+// carry the sender's SessionParameters, and a mismatch fails the connection on either side. A
+// Disconnect from the peer ends the connection right away instead of after the idle timeout.
+class UdpNetworkThread : public NetworkThread
+{
+public:
+    // makes outgoing datagrams go through a LinkShim, has to be called before start()
+    void set_link_conditions(const LinkConditions &conditions, unsigned seed);
+    const LinkShim *link_shim() const { return link_shim_.get(); }
+
+protected:
+    using Clock = std::chrono::steady_clock;
+
+    UdpNetworkThread(const boost::asio::ip::udp::endpoint &local_endpoint);
+
+    void send_message(const Message &message) override;
+    void flush_messages() override;
+    virtual void handle_handshake(PacketType type, PacketReader &reader) = 0;
+    virtual void update_connecting(Clock::time_point now) = 0;
+
+    void set_connected();
+    void send_handshake(PacketType type);
+
+    void do_receive();
+    void start_timer();
+
+    boost::asio::ip::udp::socket socket_;
+    boost::asio::ip::udp::endpoint sender_endpoint_; // of the datagram being handled
+    boost::asio::ip::udp::endpoint peer_endpoint_;
+    UdpChannel channel_;
+
+private:
+    void handle_packet(std::size_t size);
+    void handle_data(PacketReader &reader);
+    void handle_disconnect(PacketReader &reader);
+    void send_data();
+    void send_packet(const std::vector<uint8_t> &data);
+    void handle_timer();
+
+    boost::asio::steady_timer timer_;
+    std::unique_ptr<LinkShim> link_shim_;
+    std::vector<uint8_t> receive_buffer_;
+    std::vector<Message> received_messages_;
+};
+
+class UdpServerNetworkThread : public UdpNetworkThread
+{
+public:
+    UdpServerNetworkThread(int port);
+    ~UdpServerNetworkThread() override;
+
+private:
+    void do_connect() override;
+    void handle_handshake(PacketType type, PacketReader &reader) override;
+    void update_connecting(Clock::time_point now) override;
+};
+
+class UdpClientNetworkThread : public UdpNetworkThread
+{
+public:
+    UdpClientNetworkThread(std::string_view host, std::string_view service);
+    ~UdpClientNetworkThread() override;
+
+private:
+    void do_connect() override;
+    void handle_handshake(PacketType type, PacketReader &reader) override;
+    void update_connecting(Clock::time_point now) override;
+
+    Clock::time_point connect_time_;
+    Clock::time_point last_hello_time_;
+};
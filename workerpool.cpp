@@ -0,0 +1,77 @@
+#include "workerpool.h"
+
+#include <algorithm>
+
+WorkerPool::WorkerPool(int thread_count)
+{
+    threads_.reserve(thread_count);
+    for (int i = 0; i < thread_count; ++i)
+        threads_.emplace_back([this, i] { worker_loop(i); });
+}
+
+WorkerPool::~WorkerPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        shutdown_ = true;
+    }
+    work_ready_.notify_all();
+
+    for (auto &thread : threads_)
+        thread.join();
+}
+
+void WorkerPool::parallel_for(std::size_t count, int max_shares, const Job &job)
+{
+    if (threads_.empty() || max_shares <= 1)
+    {
+        job(0, count);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        job_ = &job;
+        count_ = count;
+        shares_ = std::min<int>(max_shares, threads_.size());
+        pending_ = threads_.size();
+        ++generation_;
+    }
+    work_ready_.notify_all();
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    work_done_.wait(lock, [this] { return pending_ == 0; });
+    job_ = nullptr;
+}
+
+std::pair<std::size_t, std::size_t> WorkerPool::share(int index) const
+{
+    if (index >= shares_)
+        return {0, 0};
+    return {count_ * index / shares_, count_ * (index + 1) / shares_};
+}
+
+void WorkerPool::worker_loop(int index)
+{
+    int cur_generation = 0;
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;)
+    {
+        work_ready_.wait(lock, [this, &cur_generation] { return shutdown_ || generation_ != cur_generation; });
+        if (shutdown_)
+            break;
+        cur_generation = generation_;
+
+        const auto *job = job_;
+        const auto [begin, end] = share(index);
+
+        lock.unlock();
+        if (begin != end)
+            (*job)(begin, end);
+        lock.lock();
+
+        if (--pending_ == 0)
+            work_done_.notify_one();
+    }
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <boost/noncopyable.hpp>
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A fixed set of threads for splitting loops. The calling thread only waits, so that it's free for whatever
+// can't be handed out, and parallel_for() returns once every share is done.
+class WorkerPool : private boost::noncopyable
+{
+public:
+    explicit WorkerPool(int thread_count);
+    ~WorkerPool();
+
+    int thread_count() const { return threads_.size(); }
+
+    using Job = std::function<void(std::size_t begin, std::size_t end)>;
+
+    // Splits [0, count) into at most max_shares contiguous ranges and calls job on each, one per thread. With no
+    // threads at all, the caller does the whole range.
+    void parallel_for(std::size_t count, int max_shares, const Job &job);
+
+private:
+    void worker_loop(int index);
+    std::pair<std::size_t, std::size_t> share(int index) const;
+
+    std::vector<std::thread> threads_;
+    std::mutex mutex_;
+    std::condition_variable work_ready_;
+    std::condition_variable work_done_;
+    const Job *job_ = nullptr;
+    std::size_t count_ = 0;
+    int shares_ = 0;
+    int generation_ = 0;
+    int pending_ = 0;
+    bool shutdown_ = false;
+};
@@ -3,38 +3,29 @@
 #include "tilesheet.h"
 #include "trajectory.h"
 #include "level.h"
-#include "spritebatcher.h"
 #include "foeclass.h"
 #include "dpadstate.h"
 
 #include <glm/vec4.hpp>
 #include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <ostream>
 
 #define DRAW_COLLISIONS
 
-extern SpriteBatcher *g_sprite_batcher; // XXX
-extern std::vector<FoeClass> g_foe_classes; // XXX
-
-static constexpr const auto SpriteScale = 2.0f;
 static constexpr const auto MissileSpawnInterval = 8;
 static constexpr const auto DamageFlashInterval = 36;
 
-static void draw_tile(const Tile *tile, const glm::vec2 &pos, const glm::vec4 &flat_color, int depth)
+static void draw_tile(RenderList &list, const Tile *tile, const glm::vec2 &pos, const glm::vec2 &prev_pos,
+                      const glm::vec4 &flat_color, int depth)
 {
-    const auto half_width = 0.5f * tile->size.x * SpriteScale;
-    const auto half_height = 0.5f * tile->size.y * SpriteScale;
-
-    const auto p0 = pos + glm::vec2(-half_width, -half_height);
-    const auto p1 = pos + glm::vec2(-half_width, half_height);
-    const auto p2 = pos + glm::vec2(half_width, half_height);
-    const auto p3 = pos + glm::vec2(half_width, -half_height);
-
-    g_sprite_batcher->add_sprite(tile, {{p0, p1, p2, p3}}, flat_color, depth);
+    list.sprites.push_back({tile, pos, prev_pos, flat_color, depth});
 }
 
-static void draw_tile(const Tile *tile, const glm::vec2 &pos, int depth)
+static void draw_tile(RenderList &list, const Tile *tile, const glm::vec2 &pos, const glm::vec2 &prev_pos, int depth)
 {
-    draw_tile(tile, pos, glm::vec4(0.0f), depth);
+    draw_tile(list, tile, pos, prev_pos, glm::vec4(0.0f), depth);
 }
 
 static glm::vec2 tile_top_left(const Tile *tile, const glm::vec2 &center)
@@ -48,6 +39,80 @@ static bool test_collision(const CollisionMask &sprite1, const glm::vec2 &pos1,
     return sprite2.collides_with(sprite1, pos);
 }
 
+static uint64_t hash_combine(uint64_t hash, int64_t value)
+{
+    hash ^= static_cast<uint64_t>(value) + 0x9e3779b97f4a7c15ull + (hash << 6) + (hash >> 2);
+    return hash;
+}
+
+// to 1/16 pixel, so checksums don't hinge on the last bits of a float
+static int64_t quantize(float value)
+{
+    return std::lround(value * 16.0f);
+}
+
+static glm::ivec2 snapshot_position(const glm::vec2 &position)
+{
+    return {static_cast<int>(std::lround(position.x * Snapshot::PositionScale)),
+            static_cast<int>(std::lround(position.y * Snapshot::PositionScale))};
+}
+
+static uint64_t hash_combine(uint64_t hash, const glm::vec2 &value)
+{
+    return hash_combine(hash_combine(hash, quantize(value.x)), quantize(value.y));
+}
+
+static uint64_t hash_combine(uint64_t hash, const Player &player)
+{
+    hash = hash_combine(hash, player.position);
+    hash = hash_combine(hash, player.cur_frame);
+    return hash_combine(hash, player.fire_tics);
+}
+
+static uint64_t hash_combine(uint64_t hash, const Foe &foe)
+{
+    hash = hash_combine(hash, foe.id);
+    hash = hash_combine(hash, foe.type);
+    hash = hash_combine(hash, foe.position);
+    hash = hash_combine(hash, quantize(foe.trajectory_position));
+    hash = hash_combine(hash, foe.shields);
+    hash = hash_combine(hash, foe.damage_tics);
+    return hash_combine(hash, foe.cur_tic);
+}
+
+static uint64_t hash_combine(uint64_t hash, const Missile &missile)
+{
+    return hash_combine(hash_combine(hash, missile.id), missile.position);
+}
+
+static uint64_t hash_combine(uint64_t hash, const Explosion &explosion)
+{
+    hash = hash_combine(hash, explosion.id);
+    hash = hash_combine(hash, explosion.cur_frame);
+    return hash_combine(hash, explosion.position);
+}
+
+static constexpr const char *PlayerFrameTiles[] = {"player-0.png", "player-1.png", "player-2.png", "player-3.png"};
+
+// Shared by every World rather than members, so that the copies kept for rollback don't copy them too. One per
+// player frame, like foe classes have.
+static const CollisionMask &player_collision_mask(int frame)
+{
+    static const std::vector<CollisionMask> masks = [] {
+        std::vector<CollisionMask> masks;
+        for (const auto *name : PlayerFrameTiles)
+            masks.emplace_back(get_tile(name));
+        return masks;
+    }();
+    return masks[frame];
+}
+
+static const CollisionMask &missile_collision_mask()
+{
+    static const CollisionMask mask(get_tile("missile.png"));
+    return mask;
+}
+
 const std::vector<const Tile *> &get_explosion_frames()
 {
     static const std::vector<const Tile *> tiles = []{
@@ -68,8 +133,7 @@ const std::vector<const Tile *> &get_explosion_frames()
 
 Player::Player()
 {
-    const auto frame_tiles = {"player-0.png", "player-1.png", "player-2.png", "player-3.png"};
-    std::transform(frame_tiles.begin(), frame_tiles.end(), std::back_inserter(frames), [](const auto tile) {
+    std::transform(std::begin(PlayerFrameTiles), std::end(PlayerFrameTiles), std::back_inserter(frames), [](const auto tile) {
         return get_tile(tile);
     });
 
@@ -79,11 +143,13 @@ Player::Player()
     });
 }
 
-Foe::Foe(const Wave *wave)
-    : type(wave->foe_type)
+Foe::Foe(const Wave *wave, uint32_t id)
+    : id(id)
+    , type(wave->foe_type)
     , speed(wave->foe_speed)
     , trajectory(wave->trajectory)
     , position(trajectory->point_at(0.0f))
+    , prev_position(position)
     , trajectory_position(0.0f)
     , shields(g_foe_classes[type].shields)
 {
@@ -92,18 +158,13 @@ Foe::Foe(const Wave *wave)
 World::World(int width, int height)
     : width_(width)
     , height_(height)
-    , player_sprite_(get_tile("player-0.png"))
-    , missile_sprite_(get_tile("missile.png"))
 {
-    player_.position = glm::vec2(0.5f * width, 0.5f * height);
-
-#ifdef DRAW_ACTIVE_TRAJECTORIES
-    trajectory_program_.add_shader(GL_VERTEX_SHADER, "resources/shaders/dummy.vert");
-    trajectory_program_.add_shader(GL_FRAGMENT_SHADER, "resources/shaders/dummy.frag");
-    trajectory_program_.link();
-#endif
+    player_.position = player_.prev_position = glm::vec2(0.5f * width, 0.5f * height);
 
-    get_explosion_frames(); // preload
+    // preload
+    get_explosion_frames();
+    player_collision_mask(0);
+    missile_collision_mask();
 }
 
 void World::initialize_level(const Level *level)
@@ -118,7 +179,7 @@ void World::initialize_level(const Level *level)
 #if 0
     {
         const auto *wave = level->waves.front().get();
-        Foe foe(wave);
+        Foe foe(wave, next_entity_id_++);
         foe.position = {250.f, 220.f};
         foes_.push_back(foe);
     }
@@ -127,85 +188,127 @@ void World::initialize_level(const Level *level)
 #endif
 }
 
-void World::render() const
+void World::render(RenderList &list) const
 {
-#ifdef DRAW_ACTIVE_TRAJECTORIES
-    trajectory_program_.bind();
-    trajectory_program_.set_uniform(trajectory_program_.uniform_location("mvp"), g_sprite_batcher->transform_matrix());
+    list.tic = cur_tic_;
 
-    for (const auto &wave : active_waves_)
-    {
-        wave->geometry.render(GL_LINE_STRIP);
-    }
+#ifdef DRAW_ACTIVE_TRAJECTORIES
+    for (const auto *wave : active_waves_)
+        list.trajectories.push_back(wave->trajectory);
 #endif
 
 #ifdef DRAW_COLLISIONS
-    {
-        bool has_collisions = std::any_of(foes_.begin(), foes_.end(), [this](const Foe &foe) {
-            const auto &frame = g_foe_classes[foe.type].frames[foe.cur_frame];
-            return test_collision(frame.collision_mask, foe.position, player_sprite_, player_.position);
-        });
-        if (has_collisions)
-        {
-            glClearColor(1, 0, 0, 1);
-            glClear(GL_COLOR_BUFFER_BIT);
-        }
-    }
+    list.collision = std::any_of(foes_.begin(), foes_.end(), [this](const Foe &foe) {
+        const auto &frame = g_foe_classes[foe.type].frames[foe.cur_frame];
+        return test_collision(frame.collision_mask, foe.position, player_collision_mask(player_.cur_frame),
+                              player_.position);
+    });
 #endif
 
     for (const auto &foe : foes_)
     {
         const auto &frame = g_foe_classes[foe.type].frames[foe.cur_frame];
         const auto a = static_cast<float>(foe.damage_tics) / DamageFlashInterval;
-        draw_tile(frame.tile, foe.position, glm::vec4(1.0f, 0.0f, 0.0f, a), 0);
+        draw_tile(list, frame.tile, foe.position, foe.prev_position, glm::vec4(1.0f, 0.0f, 0.0f, a), 0);
     }
 
-    const auto *missile_tile = missile_sprite_.tile;
+    const auto *missile_tile = missile_collision_mask().tile;
     for (const auto &missile : missiles_)
-        draw_tile(missile_tile, missile.position, 0);
+        draw_tile(list, missile_tile, missile.position, missile.prev_position, 0);
 
-    draw_tile(player_.frames[player_.cur_frame], player_.position, 0);
+    draw_tile(list, player_.frames[player_.cur_frame], player_.position, player_.prev_position, 0);
     if (player_.fire_tics > 0)
     {
         int spark_frame = (MissileSpawnInterval - player_.fire_tics) * player_.sparks.size() / MissileSpawnInterval;
-        draw_tile(player_.sparks[spark_frame], player_.position - static_cast<float>(SpriteScale) * glm::vec2(-9.5, 12.5), 0);
-        draw_tile(player_.sparks[spark_frame], player_.position - static_cast<float>(SpriteScale) * glm::vec2(9.5, 12.5), 0);
+        for (const auto &offset : {glm::vec2(-9.5, 12.5), glm::vec2(9.5, 12.5)})
+        {
+            const auto spark_offset = static_cast<float>(SpriteScale) * offset;
+            draw_tile(list, player_.sparks[spark_frame], player_.position - spark_offset,
+                      player_.prev_position - spark_offset, 0);
+        }
     }
 
     const auto &explosion_frames = get_explosion_frames();
     for (const auto &explosion : explosions_)
-        draw_tile(explosion_frames[explosion.cur_frame], explosion.position, -1);
+        draw_tile(list, explosion_frames[explosion.cur_frame], explosion.position, explosion.position, -1);
 }
 
-World::ActiveWave::ActiveWave(const Wave *wave)
-    : wave(wave)
+void World::snapshot(Snapshot &snapshot) const
 {
-#ifdef DRAW_ACTIVE_TRAJECTORIES
-    const auto *trajectory = wave->trajectory;
+    snapshot.tic = cur_tic_;
+    snapshot.player = {snapshot_position(player_.position), player_.cur_frame, player_.fire_tics};
 
-    std::vector<std::tuple<glm::vec2>> verts;
+    snapshot.foes.clear();
+    for (const auto &foe : foes_)
+        snapshot.foes.push_back({foe.id, foe.type, snapshot_position(foe.position), foe.cur_frame, foe.damage_tics});
 
-    constexpr const auto NumVerts = 100;
-    for (int i = 0; i < NumVerts; ++i)
-    {
-        const auto t = static_cast<float>(i) / (NumVerts - 1);
-        const auto d = t * trajectory->length();
-        const auto v = trajectory->point_at(d);
-        verts.emplace_back(v);
-    }
+    snapshot.missiles.clear();
+    for (const auto &missile : missiles_)
+        snapshot.missiles.push_back({missile.id, snapshot_position(missile.position)});
 
-    geometry.set_data(verts);
-#endif
+    snapshot.explosions.clear();
+    for (const auto &explosion : explosions_)
+        snapshot.explosions.push_back({explosion.id, snapshot_position(explosion.position), explosion.cur_frame});
 }
 
+// Every pass folds what it leaves behind into the checksum while it's at it, so there's no second walk over
+// the entities; everything that moves gets touched every tic anyway.
 void World::advance(unsigned dpad_state)
 {
     ++cur_tic_;
+    if (checksums_enabled_)
+        checksum_ = hash_combine(checksum_, cur_tic_);
+
     advance_waves();
     advance_missiles();
     advance_foes();
     advance_player(dpad_state);
     advance_explosions();
+
+    if (checksums_enabled_)
+    {
+        checksum_ = hash_combine(checksum_, active_waves_.size());
+        checksum_ = hash_combine(checksum_, foes_.size());
+        checksum_ = hash_combine(checksum_, missiles_.size());
+        checksum_ = hash_combine(checksum_, explosions_.size());
+        checksum_ = hash_combine(checksum_, next_entity_id_);
+    }
+}
+
+void World::dump(std::ostream &out) const
+{
+    const auto flags = out.flags();
+    const auto precision = out.precision(9); // enough to round trip a float
+
+    out << "tic " << cur_tic_ << " checksum " << std::hex << checksum_ << std::dec << '\n';
+    out << "next entity id " << next_entity_id_ << '\n';
+    out << "active waves " << active_waves_.size() << '\n';
+    for (const auto *wave : active_waves_)
+        out << "  start_tic " << wave->start_tic << '\n';
+    out << "player " << player_.position.x << ' ' << player_.position.y << " frame " << player_.cur_frame
+        << " fire_tics " << player_.fire_tics << '\n';
+
+    out << "foes " << foes_.size() << '\n';
+    for (const auto &foe : foes_)
+    {
+        out << "  id " << foe.id << " type " << foe.type << " position " << foe.position.x << ' ' << foe.position.y
+            << " trajectory_position " << foe.trajectory_position << " shields " << foe.shields << " damage_tics "
+            << foe.damage_tics << " tic " << foe.cur_tic << '\n';
+    }
+
+    out << "missiles " << missiles_.size() << '\n';
+    for (const auto &missile : missiles_)
+        out << "  id " << missile.id << " position " << missile.position.x << ' ' << missile.position.y << '\n';
+
+    out << "explosions " << explosions_.size() << '\n';
+    for (const auto &explosion : explosions_)
+    {
+        out << "  id " << explosion.id << " frame " << explosion.cur_frame << " position " << explosion.position.x
+            << ' ' << explosion.position.y << '\n';
+    }
+
+    out.precision(precision);
+    out.flags(flags);
 }
 
 void World::advance_waves()
@@ -214,17 +317,23 @@ void World::advance_waves()
     {
         if (wave->start_tic == cur_tic_)
         {
-            active_waves_.emplace_back(new ActiveWave(wave.get()));
+            active_waves_.push_back(wave.get());
         }
     }
 
     auto it = active_waves_.begin();
     while (it != active_waves_.end())
     {
-        if (!advance_active_wave(**it))
+        if (!advance_active_wave(*it))
+        {
             it = active_waves_.erase(it);
+        }
         else
+        {
+            if (checksums_enabled_)
+                checksum_ = hash_combine(checksum_, (*it)->start_tic);
             ++it;
+        }
     }
 }
 
@@ -234,16 +343,27 @@ void World::advance_foes()
     while (it != foes_.end())
     {
         if (!advance_foe(*it))
+        {
             it = foes_.erase(it);
+        }
         else
+        {
+            if (checksums_enabled_)
+                checksum_ = hash_combine(checksum_, *it);
             ++it;
+        }
     }
 }
 
 void World::spawn_missiles()
 {
-    missiles_.push_back({player_.position - static_cast<float>(SpriteScale) * glm::vec2(-9.5, 12.5)});
-    missiles_.push_back({player_.position - static_cast<float>(SpriteScale) * glm::vec2(9.5, 12.5)});
+    for (const auto &offset : {glm::vec2(-9.5, 12.5), glm::vec2(9.5, 12.5)})
+    {
+        const auto position = player_.position - static_cast<float>(SpriteScale) * offset;
+        missiles_.push_back({next_entity_id_++, position, position});
+        if (checksums_enabled_)
+            checksum_ = hash_combine(checksum_, missiles_.back());
+    }
 
     assert(player_.fire_tics == 0);
     player_.fire_tics = MissileSpawnInterval;
@@ -254,6 +374,8 @@ void World::advance_player(unsigned dpad_state)
     constexpr float Speed = 2.0f;
     constexpr float Margin = 12;
 
+    player_.prev_position = player_.position;
+
     if ((dpad_state & DPad_Up) && player_.position.y > Margin)
         player_.position.y -= Speed;
     if ((dpad_state & DPad_Down) && player_.position.y < height_ - Margin)
@@ -269,6 +391,9 @@ void World::advance_player(unsigned dpad_state)
         --player_.fire_tics;
 
     player_.cur_frame = (cur_tic_ / 4) % player_.frames.size();
+
+    if (checksums_enabled_)
+        checksum_ = hash_combine(checksum_, player_);
 }
 
 void World::advance_missiles()
@@ -277,9 +402,15 @@ void World::advance_missiles()
     while (it != missiles_.end())
     {
         if (!advance_missile(*it))
+        {
             it = missiles_.erase(it);
+        }
         else
+        {
+            if (checksums_enabled_)
+                checksum_ = hash_combine(checksum_, *it);
             ++it;
+        }
     }
 }
 
@@ -289,20 +420,24 @@ void World::advance_explosions()
     while (it != explosions_.end())
     {
         if (!advance_explosion(*it))
+        {
             it = explosions_.erase(it);
+        }
         else
+        {
+            if (checksums_enabled_)
+                checksum_ = hash_combine(checksum_, *it);
             ++it;
+        }
     }
 }
 
-bool World::advance_active_wave(ActiveWave &active_wave)
+bool World::advance_active_wave(const Wave *wave)
 {
-    const auto *wave = active_wave.wave;
-
     const auto wave_tic = cur_tic_ - wave->start_tic;
     if (wave_tic % wave->spawn_interval == 0)
     {
-        foes_.emplace_back(wave);
+        foes_.emplace_back(wave, next_entity_id_++);
         if (wave_tic == wave->spawn_interval * (wave->spawn_count - 1))
             return false;
     }
@@ -317,6 +452,7 @@ bool World::advance_foe(Foe &foe)
     const auto &foe_class = g_foe_classes[foe.type];
     foe.cur_frame = (foe.cur_tic / foe_class.tics_per_frame) % foe_class.frames.size();
 
+    foe.prev_position = foe.position;
     foe.trajectory_position += foe.speed;
     if (foe.trajectory_position > foe.trajectory->length())
         return false;
@@ -332,17 +468,19 @@ bool World::advance_foe(Foe &foe)
 bool World::advance_missile(Missile &missile)
 {
     constexpr const auto Speed = 18.0f;
+    missile.prev_position = missile.position;
     missile.position += glm::vec2(0.f, -Speed);
 
-    const auto *missile_tile = missile_sprite_.tile;
+    const auto &missile_mask = missile_collision_mask();
+    const auto *missile_tile = missile_mask.tile;
     const auto &missile_size = missile_tile->size;
     const float min_y = -SpriteScale * 0.5f * missile_size.y;
     if (missile.position.y < min_y)
         return false;
 
-    auto it = std::find_if(foes_.begin(), foes_.end(), [this, &missile](Foe &foe) {
+    auto it = std::find_if(foes_.begin(), foes_.end(), [&missile_mask, &missile](Foe &foe) {
         const auto &frame = g_foe_classes[foe.type].frames[foe.cur_frame];
-        return test_collision(missile_sprite_, missile.position, frame.collision_mask, foe.position);
+        return test_collision(missile_mask, missile.position, frame.collision_mask, foe.position);
     });
     if (it != foes_.end())
     {
@@ -354,7 +492,7 @@ bool World::advance_missile(Missile &missile)
         }
         else
         {
-            explosions_.push_back({0, foe.position});
+            explosions_.push_back({next_entity_id_++, 0, foe.position});
             foes_.erase(it);
         }
         return false;
@@ -1,17 +1,16 @@
 #pragma once
 
 #include "collisionmask.h"
+#include "renderlist.h"
+#include "snapshot.h"
 
 #include <glm/vec2.hpp>
 
+#include <cstdint>
+#include <iosfwd>
 #include <vector>
 #include <memory>
 
-#ifdef DRAW_ACTIVE_TRAJECTORIES
-#include "geometry.h"
-#include "shaderprogram.h"
-#endif
-
 struct Level;
 struct Tile;
 struct Wave;
@@ -24,29 +23,35 @@ struct Player
     std::vector<const Tile *> frames;
     std::vector<const Tile *> sparks;
     glm::vec2 position;
+    glm::vec2 prev_position; // at the previous tic, for interpolation
     int cur_frame = 0;
     int fire_tics = 0;
 };
 
 struct Missile
 {
+    uint32_t id;
     glm::vec2 position;
+    glm::vec2 prev_position;
 };
 
 struct Explosion
 {
+    uint32_t id;
     int cur_frame = 0;
     glm::vec2 position;
 };
 
 struct Foe
 {
-    Foe(const Wave *wave);
+    Foe(const Wave *wave, uint32_t id);
 
+    uint32_t id;
     int type;
     float speed;
     const Trajectory *trajectory;
     glm::vec2 position;
+    glm::vec2 prev_position;
     float trajectory_position;
     int shields;
     int damage_tics = 0;
@@ -54,6 +59,7 @@ struct Foe
     int cur_tic = 0;
 };
 
+// Copyable, so that states can be saved and restored for rollback.
 class World
 {
 public:
@@ -61,7 +67,25 @@ public:
 
     void initialize_level(const Level *level);
     void advance(unsigned dpad_state);
-    void render() const;
+    void render(RenderList &list) const; // appends to list
+
+    // what spectators get to see
+    void snapshot(Snapshot &snapshot) const;
+
+    int tic() const { return cur_tic_; }
+
+    // Hash of the state after every tic so far, chained, so a difference at any point shows up in every
+    // checksum after it. Positions are quantized.
+    uint64_t checksum() const { return checksum_; }
+
+    // on by default, off only to measure what they cost
+    void set_checksums_enabled(bool enabled) { checksums_enabled_ = enabled; }
+
+    // folded to what goes over the wire
+    uint32_t wire_checksum() const { return checksum_ ^ (checksum_ >> 32); }
+
+    // everything that goes into the checksum, as text, for diffing states that should have been the same
+    void dump(std::ostream &out) const;
 
 private:
     void advance_waves();
@@ -71,16 +95,7 @@ private:
     void advance_explosions();
     void spawn_missiles();
 
-    struct ActiveWave
-    {
-        ActiveWave(const Wave *wave);
-        const Wave *wave;
-#ifdef DRAW_ACTIVE_TRAJECTORIES
-        Geometry<std::tuple<glm::vec2>> geometry;
-#endif
-    };
-
-    bool advance_active_wave(ActiveWave &wave);
+    bool advance_active_wave(const Wave *wave);
     bool advance_foe(Foe &foe);
     bool advance_missile(Missile &missile);
     bool advance_explosion(Explosion &explosion);
@@ -88,15 +103,13 @@ private:
     const Level *cur_level_ = nullptr;
     int width_;
     int height_;
-    std::vector<std::unique_ptr<ActiveWave>> active_waves_;
+    std::vector<const Wave *> active_waves_;
     std::vector<Foe> foes_;
     std::vector<Missile> missiles_;
     std::vector<Explosion> explosions_;
     Player player_;
-    CollisionMask player_sprite_; // XXX for now
-    CollisionMask missile_sprite_; // XXX for now
     int cur_tic_ = 0;
-#ifdef DRAW_ACTIVE_TRAJECTORIES
-    ShaderProgram trajectory_program_;
-#endif
+    uint32_t next_entity_id_ = 1; // for foes, missiles and explosions
+    uint64_t checksum_ = 0;
+    bool checksums_enabled_ = true;
 };
@@ -0,0 +1,69 @@
+#include "panic.h"
+
+#include "tilesheet.h"
+#include "trajectory.h"
+#include "level.h"
+#include "foeclass.h"
+#include "matchserver.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+
+#include <unistd.h>
+
+// Hosts as many matches as clients show up for, two players each, without a window. Clients connect with
+// the game's -c to the lobby port; the matches are run by one worker per core on the ports after it.
+
+namespace
+{
+constexpr auto DefaultPort = 4141; // the game's
+}
+
+static void usage(const char *argv0)
+{
+    std::cerr << "usage: " << argv0 << " [-p port] [-w workers]\n";
+    std::exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+    int port = DefaultPort;
+    int workers = std::max(1u, std::thread::hardware_concurrency());
+
+    int c;
+    while ((c = getopt(argc, argv, "p:w:")) != EOF)
+    {
+        switch (c)
+        {
+            case 'p':
+                port = std::atoi(optarg);
+                break;
+
+            case 'w':
+                workers = std::atoi(optarg);
+                break;
+
+            default:
+                usage(argv[0]);
+        }
+    }
+
+    if (workers <= 0)
+        usage(argv[0]);
+
+    cache_tilesheet("resources/tilesheets/sheet.json");
+    initialize_foe_classes();
+
+    {
+        const auto level = load_level("resources/levels/level-0.json");
+
+        MatchServer server(level.get(), port, workers);
+        std::cout << "lobby on port " << port << ", " << workers << " workers on ports " << port + 1 << '-'
+                  << port + workers << '\n';
+        server.run();
+    }
+
+    release_tilesheets();
+}